@@ -0,0 +1,310 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#include "ksanechunkring.h"
+
+#include <QtTest>
+#include <QThread>
+#include <QElapsedTimer>
+
+using namespace KSaneIface;
+
+static const int TEST_CHUNKS     = 16;
+static const int TEST_CHUNK_SIZE = 4096;
+
+// The simulated scan: the device needs READ_USECS for every chunk and the
+// conversion of a chunk takes CONVERT_USECS of CPU time.
+static const int SCAN_CHUNKS   = 400;
+static const int READ_USECS    = 300;
+static const int CONVERT_USECS = 250;
+
+// the wait of the reader when the ring is full, like in KSaneScanThread
+static const int RING_WAIT_USECS = 500;
+
+// The direct read benchmark: an A4 RGB scan at 300 dpi read in requests of
+// the default sane_read() size
+static const int IMAGE_BYTES = 2480 * 3508 * 3;
+static const int READ_BYTES  = 100000;
+
+/** Keep the CPU busy like a conversion does. */
+static void spin(int usecs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.nsecsElapsed() < usecs * 1000) {
+    }
+}
+
+/** Writes SCAN_CHUNKS chunks with a sequence number into the ring. */
+class ChunkProducer: public QThread
+{
+public:
+    ChunkProducer(KSaneChunkRing *ring, bool simulateDevice):
+        m_ring(ring), m_simulateDevice(simulateDevice), m_idleUsecs(0) {}
+
+    qint64 idleUsecs() const
+    {
+        return m_idleUsecs;
+    }
+
+protected:
+    void run()
+    {
+        QElapsedTimer stallTimer;
+        for (int i = 0; i < SCAN_CHUNKS;) {
+            KSaneChunkRing::Chunk *chunk = m_ring->writeChunk();
+            if (chunk == 0) {
+                stallTimer.start();
+                QThread::usleep(RING_WAIT_USECS);
+                m_idleUsecs += stallTimer.nsecsElapsed() / 1000;
+                continue;
+            }
+            if (m_simulateDevice) {
+                QThread::usleep(READ_USECS);
+            }
+            chunk->bytes = 1 + (i * 37) % TEST_CHUNK_SIZE;
+            chunk->frame = i;
+            chunk->data[0] = (SANE_Byte)i;
+            chunk->data[chunk->bytes - 1] = (SANE_Byte)(i * 3);
+            m_ring->commitWrite();
+            i++;
+        }
+    }
+
+private:
+    KSaneChunkRing *m_ring;
+    bool            m_simulateDevice;
+    qint64          m_idleUsecs;
+};
+
+/** A backend that copies its image out of its own buffer like sane_read(). */
+class FakeSaneSource
+{
+public:
+    explicit FakeSaneSource(const QByteArray &image): m_image(image), m_pos(0) {}
+
+    /** @return false at the end of the image. */
+    bool read(uchar *data, int maxLength, int *length)
+    {
+        *length = qMin(maxLength, m_image.size() - m_pos);
+        memcpy(data, m_image.constData() + m_pos, *length);
+        m_pos += *length;
+        return *length > 0;
+    }
+
+private:
+    const QByteArray m_image;
+    int m_pos;
+};
+
+/** The reader stage of KSaneScanThread: fills the chunks of the ring from the source. */
+class SourceReader: public QThread
+{
+public:
+    SourceReader(KSaneChunkRing *ring, FakeSaneSource *source): m_ring(ring), m_source(source) {}
+
+protected:
+    void run()
+    {
+        forever {
+            KSaneChunkRing::Chunk *chunk = m_ring->writeChunk();
+            if (chunk == 0) {
+                QThread::usleep(RING_WAIT_USECS);
+                continue;
+            }
+            bool more = m_source->read(chunk->data.data(), READ_BYTES, &chunk->bytes);
+            m_ring->commitWrite();
+            if (!more) {
+                // the empty chunk marks the end
+                return;
+            }
+        }
+    }
+
+private:
+    KSaneChunkRing *m_ring;
+    FakeSaneSource *m_source;
+};
+
+class ChunkRingTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testEmptyAndFull();
+    void testOrder();
+    void benchmarkReaderIdle_data();
+    void benchmarkReaderIdle();
+    void benchmarkDirectRead_data();
+    void benchmarkDirectRead();
+};
+
+void ChunkRingTest::testEmptyAndFull()
+{
+    KSaneChunkRing ring(4, TEST_CHUNK_SIZE);
+    QVERIFY(ring.isEmpty());
+    QVERIFY(ring.readChunk() == 0);
+
+    // one slot is always left empty
+    for (int i = 0; i < 3; ++i) {
+        QVERIFY(ring.writeChunk() != 0);
+        ring.commitWrite();
+    }
+    QVERIFY(ring.writeChunk() == 0);
+    QVERIFY(!ring.isEmpty());
+
+    QVERIFY(ring.readChunk() != 0);
+    ring.commitRead();
+    QVERIFY(ring.writeChunk() != 0);
+
+    ring.reset();
+    QVERIFY(ring.isEmpty());
+}
+
+void ChunkRingTest::testOrder()
+{
+    KSaneChunkRing ring(TEST_CHUNKS, TEST_CHUNK_SIZE);
+    ChunkProducer producer(&ring, false);
+    producer.start();
+
+    for (int i = 0; i < SCAN_CHUNKS;) {
+        KSaneChunkRing::Chunk *chunk = ring.readChunk();
+        if (chunk == 0) {
+            QThread::yieldCurrentThread();
+            continue;
+        }
+        QCOMPARE(chunk->frame, i);
+        QCOMPARE(chunk->bytes, 1 + (i * 37) % TEST_CHUNK_SIZE);
+        QCOMPARE((int)chunk->data[0], i & 0xFF);
+        QCOMPARE((int)chunk->data[chunk->bytes - 1], (i * 3) & 0xFF);
+        ring.commitRead();
+        i++;
+    }
+    QVERIFY(producer.wait(10000));
+    QVERIFY(ring.isEmpty());
+}
+
+void ChunkRingTest::benchmarkReaderIdle_data()
+{
+    QTest::addColumn<bool>("ring");
+    QTest::newRow("read and convert in one thread") << false;
+    QTest::newRow("reader and converter threads") << true;
+}
+
+/** The time the reader does not wait for the device, in milliseconds.
+ * In one thread the reader is idle during every conversion, with the ring
+ * it is only idle when the converter falls behind by a whole ring. */
+void ChunkRingTest::benchmarkReaderIdle()
+{
+    QFETCH(bool, ring);
+    qint64 idleUsecs = 0;
+
+    if (!ring) {
+        QElapsedTimer timer;
+        for (int i = 0; i < SCAN_CHUNKS; ++i) {
+            QThread::usleep(READ_USECS);
+            timer.start();
+            spin(CONVERT_USECS);
+            idleUsecs += timer.nsecsElapsed() / 1000;
+        }
+    } else {
+        KSaneChunkRing chunks(TEST_CHUNKS, TEST_CHUNK_SIZE);
+        ChunkProducer producer(&chunks, true);
+        producer.start();
+        for (int i = 0; i < SCAN_CHUNKS;) {
+            if (chunks.readChunk() == 0) {
+                QThread::usleep(RING_WAIT_USECS);
+                continue;
+            }
+            spin(CONVERT_USECS);
+            chunks.commitRead();
+            i++;
+        }
+        QVERIFY(producer.wait(10000));
+        idleUsecs = producer.idleUsecs();
+    }
+
+    QTest::setBenchmarkResult(idleUsecs / 1000.0, QTest::WalltimeMilliseconds);
+}
+
+void ChunkRingTest::benchmarkDirectRead_data()
+{
+    QTest::addColumn<bool>("direct");
+    QTest::newRow("ring and append") << false;
+    QTest::newRow("direct into the image buffer") << true;
+}
+
+/** The throughput of a single-pass frame: read into the ring and appended
+ * to the image by the converter, or read straight into the pre-sized image. */
+void ChunkRingTest::benchmarkDirectRead()
+{
+    QFETCH(bool, direct);
+    QByteArray source(IMAGE_BYTES, Qt::Uninitialized);
+    for (int i = 0; i < source.size(); ++i) {
+        source[i] = (char)(i * 7 + (i >> 11));
+    }
+    QByteArray image;
+
+    QBENCHMARK {
+        FakeSaneSource device(source);
+        image.clear();
+        if (direct) {
+            image.resize(IMAGE_BYTES);
+            uchar *data = reinterpret_cast<uchar *>(image.data());
+            int offset = 0;
+            int length;
+            while (device.read(data + offset, qMin(READ_BYTES, IMAGE_BYTES - offset), &length)) {
+                offset += length;
+            }
+        } else {
+            image.reserve(IMAGE_BYTES);
+            KSaneChunkRing chunks(TEST_CHUNKS, READ_BYTES);
+            SourceReader reader(&chunks, &device);
+            reader.start();
+            forever {
+                KSaneChunkRing::Chunk *chunk = chunks.readChunk();
+                if (chunk == 0) {
+                    QThread::usleep(RING_WAIT_USECS);
+                    continue;
+                }
+                if (chunk->bytes == 0) {
+                    chunks.commitRead();
+                    break;
+                }
+                image.append(reinterpret_cast<const char *>(chunk->data.data()), chunk->bytes);
+                chunks.commitRead();
+            }
+            QVERIFY(reader.wait(10000));
+        }
+    }
+    QVERIFY(image == source);
+}
+
+QTEST_GUILESS_MAIN(ChunkRingTest)
+
+#include "ksanechunkringtest.moc"
@@ -0,0 +1,365 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#include "ksaneimageencoder.h"
+
+#include <QtTest>
+#include <QBuffer>
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QImageReader>
+#include <QTemporaryDir>
+
+using namespace KSaneIface;
+
+// The lines are handed to the encoder in strips of this many lines
+static const int STRIP_LINES = 7;
+
+// SANE lines may be padded
+static const int LINE_PADDING = 2;
+
+static QByteArray randomBytes(int size, uint seed)
+{
+    QByteArray data(size, 0);
+    qsrand(seed);
+    for (int i = 0; i < size; ++i) {
+        data[i] = (char)(qrand() >> 4);
+    }
+    return data;
+}
+
+static int lineBytes(int width, int depth, int channels)
+{
+    return (width * channels * depth + 7) / 8 + LINE_PADDING;
+}
+
+/** Hand the lines to @p encoder like the scan thread does. */
+static void encode(KSaneImageEncoder &encoder, const QByteArray &data, int width, int height,
+                   int depth, int channels, bool knownHeight)
+{
+    const int bytes = lineBytes(width, depth, channels);
+    encoder.begin(width, knownHeight ? height : -1, depth, channels, bytes);
+    for (int line = 0; line < height; line += STRIP_LINES) {
+        const int lines = qMin(STRIP_LINES, height - line);
+        encoder.addStrip(data.mid(line * bytes, lines * bytes));
+    }
+    encoder.finish(true);
+    encoder.wait();
+}
+
+/** The red, green and blue of a pixel of the scan data with 16 bits.
+ * @p truncated keeps only the high byte of 16 bit samples, like BMP does. */
+static void expectedPixel(const QByteArray &data, int width, int x, int y, int depth, int channels,
+                          bool truncated, quint16 *rgb)
+{
+    const uchar *line = reinterpret_cast<const uchar *>(data.constData()) +
+                        y * lineBytes(width, depth, channels);
+    if (depth == 1) {
+        // SANE line-art has 1 = black
+        const bool black = line[x / 8] & (0x80 >> (x % 8));
+        rgb[0] = rgb[1] = rgb[2] = black ? 0 : 0xFFFF;
+        return;
+    }
+    for (int c = 0; c < channels; ++c) {
+        const int i = x * channels + c;
+        quint16 sample;
+        if (depth == 8) {
+            sample = line[i] * 257;
+        } else {
+            // SANE delivers 16 bit samples in the byte order of the host
+            memcpy(&sample, line + 2 * i, sizeof(sample));
+            if (truncated) {
+                sample = (sample >> 8) * 257;
+            }
+        }
+        rgb[c] = sample;
+    }
+    if (channels == 1) {
+        rgb[1] = rgb[2] = rgb[0];
+    }
+}
+
+/** @return a description of the first pixel of @p img that differs from the scan data. */
+static QString compareImage(const QImage &img, const QByteArray &data, int width, int height,
+                            int depth, int channels, bool truncated)
+{
+    if (img.size() != QSize(width, height)) {
+        return QStringLiteral("size %1x%2").arg(img.width()).arg(img.height());
+    }
+    const bool exact = (depth == 16) && !truncated;
+    QImage rgb;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+    rgb = img.convertToFormat(exact ? QImage::Format_RGBX64 : QImage::Format_RGB32);
+#else
+    rgb = img.convertToFormat(QImage::Format_RGB32);
+#endif
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            quint16 expected[3];
+            quint16 actual[3];
+            expectedPixel(data, width, x, y, depth, channels, truncated, expected);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+            if (exact) {
+                const QRgba64 pixel = reinterpret_cast<const QRgba64 *>(rgb.constScanLine(y))[x];
+                actual[0] = pixel.red();
+                actual[1] = pixel.green();
+                actual[2] = pixel.blue();
+            } else
+#endif
+            {
+                const QRgb pixel = rgb.pixel(x, y);
+                actual[0] = qRed(pixel) * 257;
+                actual[1] = qGreen(pixel) * 257;
+                actual[2] = qBlue(pixel) * 257;
+            }
+            if (memcmp(expected, actual, sizeof(expected)) != 0) {
+                return QStringLiteral("pixel %1,%2 is %3 %4 %5 instead of %6 %7 %8")
+                       .arg(x).arg(y).arg(actual[0]).arg(actual[1]).arg(actual[2])
+                       .arg(expected[0]).arg(expected[1]).arg(expected[2]);
+            }
+        }
+    }
+    return QString();
+}
+
+static QByteArray readerFormat(KSaneWidget::EncodeFormat format)
+{
+    switch (format) {
+    case KSaneWidget::EncodeBMP:
+        return "bmp";
+    case KSaneWidget::EncodePNG:
+        return "png";
+    default:
+        return "tiff";
+    }
+}
+
+class ImageEncoderTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testEncode_data();
+    void testEncode();
+    void testBmpToMemory();
+    void testBatchToDevice();
+    void testBatchFileNames();
+    void testRemoveOnlyCreatedFiles();
+};
+
+Q_DECLARE_METATYPE(KSaneWidget::EncodeFormat)
+
+void ImageEncoderTest::testEncode_data()
+{
+    QTest::addColumn<KSaneWidget::EncodeFormat>("format");
+    QTest::addColumn<int>("width");
+    QTest::addColumn<int>("height");
+    QTest::addColumn<int>("depth");
+    QTest::addColumn<int>("channels");
+    QTest::addColumn<bool>("knownHeight");
+    QTest::addColumn<int>("prefix");
+
+    const KSaneWidget::EncodeFormat formats[] = {
+        KSaneWidget::EncodeBMP, KSaneWidget::EncodeTIFF, KSaneWidget::EncodeTIFFDeflate, KSaneWidget::EncodePNG
+    };
+    const char *const formatNames[] = { "BMP", "TIFF", "TIFF deflate", "PNG" };
+    const int kinds[][2] = { { 1, 1 }, { 8, 1 }, { 8, 3 }, { 16, 1 }, { 16, 3 } };
+    const char *const kindNames[] = { "line-art", "gray 8", "rgb 8", "gray 16", "rgb 16" };
+
+    for (int f = 0; f < 4; ++f) {
+        for (int k = 0; k < 5; ++k) {
+            const QByteArray name = QByteArray(formatNames[f]) + ' ' + kindNames[k];
+            const int depth = kinds[k][0];
+            const int channels = kinds[k][1];
+            QTest::newRow(name.constData())
+                    << formats[f] << 37 << 53 << depth << channels << true << 0;
+            // the header is patched with the number of lines at the end
+            QTest::newRow((name + ", unknown height").constData())
+                    << formats[f] << 37 << 53 << depth << channels << false << 0;
+            // the offsets in the headers are relative to the start of the image
+            QTest::newRow((name + ", after other data").constData())
+                    << formats[f] << 37 << 53 << depth << channels << true << 5;
+        }
+    }
+    // more than one TIFF strip
+    QTest::newRow("TIFF rgb 16, several strips")
+            << KSaneWidget::EncodeTIFF << 1001 << 301 << 16 << 3 << true << 3;
+    QTest::newRow("TIFF deflate rgb 16, several strips")
+            << KSaneWidget::EncodeTIFFDeflate << 1001 << 301 << 16 << 3 << false << 3;
+}
+
+/** Encode scan data to a QBuffer and read it back with QImageReader. */
+void ImageEncoderTest::testEncode()
+{
+    QFETCH(KSaneWidget::EncodeFormat, format);
+    QFETCH(int, width);
+    QFETCH(int, height);
+    QFETCH(int, depth);
+    QFETCH(int, channels);
+    QFETCH(bool, knownHeight);
+    QFETCH(int, prefix);
+
+    const QByteArray readFormat = readerFormat(format);
+    if (!QImageReader::supportedImageFormats().contains(readFormat)) {
+        QSKIP("Qt can not read this format");
+    }
+    const bool truncated = (format == KSaneWidget::EncodeBMP);
+#if QT_VERSION < QT_VERSION_CHECK(5, 13, 0)
+    if ((depth == 16) && !truncated) {
+        QSKIP("16 bit images need Qt 5.13");
+    }
+#endif
+
+    const QByteArray data = randomBytes(height * lineBytes(width, depth, channels), width + depth + channels);
+    QByteArray output;
+    QBuffer buffer(&output);
+    QVERIFY(buffer.open(QIODevice::ReadWrite));
+    QCOMPARE(buffer.write(QByteArray(prefix, 'x')), (qint64)prefix);
+
+    KSaneImageEncoder encoder;
+    encoder.setResolution(300);
+    QVERIFY(encoder.setOutput(format, QString(), &buffer));
+    encode(encoder, data, width, height, depth, channels, knownHeight);
+    QVERIFY2(encoder.succeeded(), qPrintable(encoder.errorString()));
+    QVERIFY(output.startsWith(QByteArray(prefix, 'x')));
+
+    QByteArray file = output.mid(prefix);
+    QBuffer fileBuffer(&file);
+    QImageReader reader(&fileBuffer, readFormat);
+    QImage img = reader.read();
+    QVERIFY2(!img.isNull(), qPrintable(reader.errorString()));
+    const QString difference = compareImage(img, data, width, height, depth, channels, truncated);
+    QVERIFY2(difference.isEmpty(), qPrintable(difference));
+}
+
+void ImageEncoderTest::testBmpToMemory()
+{
+    const QByteArray data = randomBytes(20 * lineBytes(31, 8, 3), 3);
+    KSaneImageEncoder encoder;
+    QVERIFY(encoder.setOutput(KSaneWidget::EncodeBMP, QString(), 0));
+    QVERIFY(encoder.toMemory());
+    encode(encoder, data, 31, 20, 8, 3, true);
+    QVERIFY2(encoder.succeeded(), qPrintable(encoder.errorString()));
+
+    QImage img = QImage::fromData(encoder.encodedData(), "BMP");
+    const QString difference = compareImage(img, data, 31, 20, 8, 3, true);
+    QVERIFY2(difference.isEmpty(), qPrintable(difference));
+}
+
+/** The images of a batch follow each other on a device. */
+void ImageEncoderTest::testBatchToDevice()
+{
+    if (!QImageReader::supportedImageFormats().contains("tiff")) {
+        QSKIP("Qt can not read TIFF");
+    }
+    const QByteArray first = randomBytes(40 * lineBytes(23, 8, 1), 5);
+    const QByteArray second = randomBytes(30 * lineBytes(17, 8, 3), 6);
+    QByteArray output;
+    QBuffer buffer(&output);
+    QVERIFY(buffer.open(QIODevice::WriteOnly));
+
+    KSaneImageEncoder encoder;
+    QVERIFY(encoder.setOutput(KSaneWidget::EncodeTIFF, QString(), &buffer));
+    encoder.startBatch();
+    encode(encoder, first, 23, 40, 8, 1, true);
+    QVERIFY2(encoder.succeeded(), qPrintable(encoder.errorString()));
+    const int firstSize = output.size();
+    encode(encoder, second, 17, 30, 8, 3, false);
+    QVERIFY2(encoder.succeeded(), qPrintable(encoder.errorString()));
+
+    QImage img = QImage::fromData(output.left(firstSize), "TIFF");
+    QString difference = compareImage(img, first, 23, 40, 8, 1, false);
+    QVERIFY2(difference.isEmpty(), qPrintable(difference));
+    img = QImage::fromData(output.mid(firstSize), "TIFF");
+    difference = compareImage(img, second, 17, 30, 8, 3, false);
+    QVERIFY2(difference.isEmpty(), qPrintable(difference));
+}
+
+/** The images of a batch after the first one get numbered file names. */
+void ImageEncoderTest::testBatchFileNames()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.path() + QStringLiteral("/scan.bmp");
+    const QByteArray data = randomBytes(10 * lineBytes(9, 8, 1), 7);
+
+    KSaneImageEncoder encoder;
+    QVERIFY(encoder.setOutput(KSaneWidget::EncodeBMP, fileName, 0));
+    encoder.startBatch();
+    for (int i = 0; i < 3; ++i) {
+        encode(encoder, data, 9, 10, 8, 1, true);
+        QVERIFY2(encoder.succeeded(), qPrintable(encoder.errorString()));
+    }
+    QVERIFY(QFile::exists(fileName));
+    QVERIFY(QFile::exists(dir.path() + QStringLiteral("/scan-2.bmp")));
+    QVERIFY(QFile::exists(dir.path() + QStringLiteral("/scan-3.bmp")));
+
+    // a new batch starts with the plain name again
+    QVERIFY(QFile::remove(fileName));
+    encoder.startBatch();
+    encode(encoder, data, 9, 10, 8, 1, true);
+    QVERIFY(QFile::exists(fileName));
+    QVERIFY(!QFile::exists(dir.path() + QStringLiteral("/scan-4.bmp")));
+    const QString difference = compareImage(QImage(fileName, "BMP"), data, 9, 10, 8, 1, true);
+    QVERIFY2(difference.isEmpty(), qPrintable(difference));
+}
+
+/** A failed image only removes a file that the encoder created. */
+void ImageEncoderTest::testRemoveOnlyCreatedFiles()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString created = dir.path() + QStringLiteral("/new.bmp");
+    const QString existing = dir.path() + QStringLiteral("/old.bmp");
+    QFile file(existing);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.close();
+    const QByteArray data = randomBytes(4 * lineBytes(8, 8, 1), 8);
+
+    KSaneImageEncoder encoder;
+    QVERIFY(encoder.setOutput(KSaneWidget::EncodeBMP, created, 0));
+    encoder.begin(8, 4, 8, 1, lineBytes(8, 8, 1));
+    encoder.addStrip(data);
+    encoder.finish(false);
+    encoder.wait();
+    QVERIFY(!encoder.succeeded());
+    QVERIFY(!QFile::exists(created));
+
+    QVERIFY(encoder.setOutput(KSaneWidget::EncodeBMP, existing, 0));
+    encoder.begin(8, 4, 8, 1, lineBytes(8, 8, 1));
+    encoder.addStrip(data);
+    encoder.finish(false);
+    encoder.wait();
+    QVERIFY(!encoder.succeeded());
+    QVERIFY(QFile::exists(existing));
+}
+
+QTEST_GUILESS_MAIN(ImageEncoderTest)
+
+#include "ksaneimageencodertest.moc"
@@ -0,0 +1,393 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#include "ksanepixelops.h"
+
+#include <QtTest>
+#include <QByteArray>
+#include <QColor>
+#include <QStringList>
+#include <QVector>
+
+using namespace KSaneIface;
+
+// the size of the benchmark data, about one 100 KB read of a film scanner
+static const int BENCHMARK_BYTES = 100 * 1024;
+
+// The index macros of the three-pass merge before PixelOps::mergePlane()
+#define index_red8_to_rgb8(i)     (i*3)
+#define index_red16_to_rgb16(i)   ((i/2)*6 + i%2)
+
+#define index_green8_to_rgb8(i)   (i*3 + 1)
+#define index_green16_to_rgb16(i) ((i/2)*6 + i%2 + 2)
+
+#define index_blue8_to_rgb8(i)    (i*3 + 2)
+#define index_blue16_to_rgb16(i)  ((i/2)*6 + i%2 + 4)
+
+/** The three-pass merge as it was done with the index macros. */
+static void referenceMerge(QByteArray &rgb, const uchar *plane, qint64 frameRead, int size, int depth, int channel)
+{
+    for (int i = 0; i < size; ++i, ++frameRead) {
+        if (depth == 8) {
+            switch (channel) {
+            case 0: rgb[(int)index_red8_to_rgb8(frameRead)] = plane[i]; break;
+            case 1: rgb[(int)index_green8_to_rgb8(frameRead)] = plane[i]; break;
+            default: rgb[(int)index_blue8_to_rgb8(frameRead)] = plane[i]; break;
+            }
+        } else {
+            switch (channel) {
+            case 0: rgb[(int)index_red16_to_rgb16(frameRead)] = plane[i]; break;
+            case 1: rgb[(int)index_green16_to_rgb16(frameRead)] = plane[i]; break;
+            default: rgb[(int)index_blue16_to_rgb16(frameRead)] = plane[i]; break;
+            }
+        }
+    }
+}
+
+/** The instruction sets the kernels can use on this CPU, without "scalar". */
+static QStringList simdInstructionSets()
+{
+    const char *const names[] = { "sse2", "ssse3", "avx2", "neon" };
+    QStringList supported;
+    for (unsigned i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (PixelOps::setInstructionSet(names[i]) && (qstrcmp(PixelOps::instructionSet(), names[i]) == 0)) {
+            supported.append(QString::fromLatin1(names[i]));
+        }
+    }
+    PixelOps::setInstructionSet(0);
+    return supported;
+}
+
+static QByteArray randomBytes(int size, uint seed)
+{
+    QByteArray data(size, 0);
+    qsrand(seed);
+    for (int i = 0; i < size; ++i) {
+        data[i] = (char)(qrand() >> 4);
+    }
+    return data;
+}
+
+// the width of a line of an A4 page at 600 dpi
+static const int BENCHMARK_PIXELS = 5100;
+
+/** The line expansions as the preview did them with QImage::setPixel(). */
+static int referenceSample(const uchar *src, int index, int sampleBytes)
+{
+    // 16 bit samples are shown with the byte at offset 1
+    return src[index * sampleBytes + sampleBytes - 1];
+}
+
+static void referenceGray(quint32 *dst, const uchar *src, int pixels, int depth)
+{
+    for (int i = 0; i < pixels; ++i) {
+        int gray = referenceSample(src, i, depth / 8);
+        dst[i] = qRgb(gray, gray, gray);
+    }
+}
+
+static void referenceRgb(quint32 *dst, const uchar *src, int pixels, int depth)
+{
+    for (int i = 0; i < pixels; ++i) {
+        dst[i] = qRgb(referenceSample(src, i * 3, depth / 8),
+                      referenceSample(src, i * 3 + 1, depth / 8),
+                      referenceSample(src, i * 3 + 2, depth / 8));
+    }
+}
+
+static void referenceMono(quint32 *dst, const uchar *src, int pixels)
+{
+    for (int i = 0; i < pixels; ++i) {
+        dst[i] = (src[i / 8] & (0x80 >> (i % 8))) ? qRgb(0, 0, 0) : qRgb(255, 255, 255);
+    }
+}
+
+/** Add one row per instruction set for the benchmarks. */
+static void addInstructionSetRows()
+{
+    QTest::addColumn<QString>("instructionSet");
+    QTest::newRow("scalar") << QStringLiteral("scalar");
+    Q_FOREACH (const QString &name, simdInstructionSets()) {
+        QTest::newRow(name.toLatin1().constData()) << name;
+    }
+}
+
+class PixelOpsTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void cleanup();
+
+    void testInvert();
+    void benchmarkInvert_data();
+    void benchmarkInvert();
+
+    void testMonoToRgb32();
+    void testLineToRgb32_data();
+    void testLineToRgb32();
+    void benchmarkLineToRgb32_data();
+    void benchmarkLineToRgb32();
+
+    void testSamples16ToHost_data();
+    void testSamples16ToHost();
+
+    void testMergePlane_data();
+    void testMergePlane();
+    void benchmarkMergePlane_data();
+    void benchmarkMergePlane();
+};
+
+void PixelOpsTest::cleanup()
+{
+    PixelOps::setInstructionSet(0);
+}
+
+void PixelOpsTest::testInvert()
+{
+    const QByteArray source = randomBytes(1024, 1);
+    const QStringList names = QStringList(QStringLiteral("scalar")) + simdInstructionSets();
+    Q_FOREACH (const QString &name, names) {
+        QVERIFY(PixelOps::setInstructionSet(name.toLatin1().constData()));
+        // odd offsets and sizes cover the unaligned start and the tail of the vector loops
+        for (int offset = 0; offset < 5; ++offset) {
+            for (int size = 0; size < 300; size += 7) {
+                QByteArray data = source;
+                PixelOps::invert(reinterpret_cast<uchar *>(data.data()) + offset, size);
+                for (int i = 0; i < source.size(); ++i) {
+                    bool inside = (i >= offset) && (i < offset + size);
+                    if ((uchar)data[i] != (uchar)(inside ? ~source[i] : source[i])) {
+                        QFAIL(qPrintable(QStringLiteral("%1 offset %2 size %3 byte %4")
+                                         .arg(name).arg(offset).arg(size).arg(i)));
+                    }
+                }
+            }
+        }
+    }
+}
+
+void PixelOpsTest::benchmarkInvert_data()
+{
+    addInstructionSetRows();
+}
+
+void PixelOpsTest::benchmarkInvert()
+{
+    QFETCH(QString, instructionSet);
+    QVERIFY(PixelOps::setInstructionSet(instructionSet.toLatin1().constData()));
+    QByteArray data = randomBytes(BENCHMARK_BYTES, 2);
+    uchar *bytes = reinterpret_cast<uchar *>(data.data());
+    QBENCHMARK {
+        PixelOps::invert(bytes, data.size());
+    }
+}
+
+void PixelOpsTest::testMonoToRgb32()
+{
+    const QByteArray source = randomBytes(64, 6);
+    const uchar *src = reinterpret_cast<const uchar *>(source.constData());
+    for (int pixels = 0; pixels < 8 * 60; pixels += 5) {
+        QVector<quint32> expected(pixels + 1, 0x12345678);
+        QVector<quint32> line(pixels + 1, 0x12345678);
+        referenceMono(expected.data(), src, pixels);
+        PixelOps::monoToRgb32(line.data(), src, pixels);
+        QVERIFY2(line == expected, qPrintable(QStringLiteral("%1 pixels").arg(pixels)));
+    }
+}
+
+void PixelOpsTest::testLineToRgb32_data()
+{
+    QTest::addColumn<bool>("color");
+    QTest::addColumn<int>("depth");
+    QTest::newRow("gray 8") << false << 8;
+    QTest::newRow("gray 16") << false << 16;
+    QTest::newRow("rgb 8") << true << 8;
+    QTest::newRow("rgb 16") << true << 16;
+}
+
+/** Compare the gray and RGB expansions of every instruction set with the
+ * per pixel reference. The last destination pixel must not be written. */
+void PixelOpsTest::testLineToRgb32()
+{
+    QFETCH(bool, color);
+    QFETCH(int, depth);
+    const int maxPixels = 100;
+    const QByteArray source = randomBytes(maxPixels * 6 + 4, 7);
+
+    const QStringList names = QStringList(QStringLiteral("scalar")) + simdInstructionSets();
+    Q_FOREACH (const QString &name, names) {
+        QVERIFY(PixelOps::setInstructionSet(name.toLatin1().constData()));
+        for (int offset = 0; offset < 4; ++offset) {
+            const uchar *src = reinterpret_cast<const uchar *>(source.constData()) + offset;
+            for (int pixels = 0; pixels < maxPixels; ++pixels) {
+                QVector<quint32> expected(pixels + 1, 0x12345678);
+                QVector<quint32> line(pixels + 1, 0x12345678);
+                if (color) {
+                    referenceRgb(expected.data(), src, pixels, depth);
+                    PixelOps::rgbToRgb32(line.data(), src, pixels, depth);
+                } else {
+                    referenceGray(expected.data(), src, pixels, depth);
+                    PixelOps::grayToRgb32(line.data(), src, pixels, depth);
+                }
+                QVERIFY2(line == expected, qPrintable(QStringLiteral("%1 offset %2 pixels %3")
+                                                      .arg(name).arg(offset).arg(pixels)));
+            }
+        }
+    }
+}
+
+void PixelOpsTest::benchmarkLineToRgb32_data()
+{
+    addInstructionSetRows();
+}
+
+void PixelOpsTest::benchmarkLineToRgb32()
+{
+    QFETCH(QString, instructionSet);
+    QVERIFY(PixelOps::setInstructionSet(instructionSet.toLatin1().constData()));
+    const QByteArray source = randomBytes(BENCHMARK_PIXELS * 3, 8);
+    const uchar *src = reinterpret_cast<const uchar *>(source.constData());
+    QVector<quint32> line(BENCHMARK_PIXELS);
+    QBENCHMARK {
+        PixelOps::rgbToRgb32(line.data(), src, BENCHMARK_PIXELS, 8);
+        PixelOps::grayToRgb32(line.data(), src, BENCHMARK_PIXELS, 8);
+    }
+}
+
+void PixelOpsTest::testSamples16ToHost_data()
+{
+    QTest::addColumn<bool>("bigEndian");
+    QTest::newRow("little endian") << false;
+    QTest::newRow("big endian") << true;
+}
+
+/** Compare samples16ToHost() and rgb48ToRgbx64() of every instruction set
+ * with samples assembled from their bytes. */
+void PixelOpsTest::testSamples16ToHost()
+{
+    QFETCH(bool, bigEndian);
+    const int maxPixels = 70;
+    const QByteArray source = randomBytes(maxPixels * 6 + 4, 11);
+
+    const QStringList names = QStringList(QStringLiteral("scalar")) + simdInstructionSets();
+    Q_FOREACH (const QString &name, names) {
+        QVERIFY(PixelOps::setInstructionSet(name.toLatin1().constData()));
+        for (int offset = 0; offset < 4; ++offset) {
+            const uchar *src = reinterpret_cast<const uchar *>(source.constData()) + offset;
+            for (int pixels = 0; pixels < maxPixels; ++pixels) {
+                QVector<quint16> expected(pixels * 4 + 1, 0x1234);
+                for (int i = 0; i < pixels * 3; ++i) {
+                    const uchar *sample = src + 2 * i;
+                    expected[i] = bigEndian ? ((sample[0] << 8) | sample[1]) : (sample[0] | (sample[1] << 8));
+                }
+                QVector<quint16> samples(pixels * 4 + 1, 0x1234);
+                PixelOps::samples16ToHost(samples.data(), src, pixels * 3, bigEndian);
+                QVERIFY2(samples == expected, qPrintable(QStringLiteral("samples %1 offset %2 pixels %3")
+                                                         .arg(name).arg(offset).arg(pixels)));
+
+                // the same samples with an opaque alpha after every third one
+                QVector<quint16> rgbx = expected;
+                for (int i = pixels - 1; i >= 0; --i) {
+                    rgbx[i * 4 + 3] = 0xFFFF;
+                    rgbx[i * 4 + 2] = expected[i * 3 + 2];
+                    rgbx[i * 4 + 1] = expected[i * 3 + 1];
+                    rgbx[i * 4] = expected[i * 3];
+                }
+                QVector<quint16> pixelData(pixels * 4 + 1, 0x1234);
+                PixelOps::rgb48ToRgbx64(pixelData.data(), src, pixels, bigEndian);
+                QVERIFY2(pixelData == rgbx, qPrintable(QStringLiteral("rgbx %1 offset %2 pixels %3")
+                                                       .arg(name).arg(offset).arg(pixels)));
+            }
+        }
+    }
+}
+
+void PixelOpsTest::testMergePlane_data()
+{
+    QTest::addColumn<int>("depth");
+    QTest::addColumn<int>("channel");
+    for (int depth = 8; depth <= 16; depth += 8) {
+        for (int channel = 0; channel < 3; ++channel) {
+            QTest::newRow(qPrintable(QStringLiteral("depth %1 channel %2").arg(depth).arg(channel)))
+                    << depth << channel;
+        }
+    }
+}
+
+void PixelOpsTest::testMergePlane()
+{
+    QFETCH(int, depth);
+    QFETCH(int, channel);
+
+    const int frameBytes = 4099;    // an odd number of 16 bit samples
+    const QByteArray frame = randomBytes(frameBytes, 3 + channel);
+    const QByteArray background = randomBytes(frameBytes * 3 + 6, 4);
+    // reads of odd sizes start in the middle of samples and leave SIMD tails
+    const int readSizes[] = { 1, 3, 7, 16, 17, 31, 48, 95, 257, 1000 };
+    const int readSizeCount = sizeof(readSizes) / sizeof(readSizes[0]);
+
+    const QStringList names = QStringList(QStringLiteral("scalar")) + simdInstructionSets();
+    Q_FOREACH (const QString &name, names) {
+        QVERIFY(PixelOps::setInstructionSet(name.toLatin1().constData()));
+        for (int first = 0; first < readSizeCount; ++first) {
+            QByteArray expected = background;
+            QByteArray merged = background;
+            const uchar *plane = reinterpret_cast<const uchar *>(frame.constData());
+            qint64 frameRead = 0;
+            for (int read = first; frameRead < frameBytes; ++read) {
+                int size = (int)qMin((qint64)readSizes[read % readSizeCount], frameBytes - frameRead);
+                referenceMerge(expected, plane + frameRead, frameRead, size, depth, channel);
+                PixelOps::mergePlane(reinterpret_cast<uchar *>(merged.data()), plane + frameRead,
+                                     frameRead, size, depth, channel);
+                frameRead += size;
+            }
+            QVERIFY2(merged == expected, qPrintable(QStringLiteral("%1 first read %2").arg(name).arg(first)));
+        }
+    }
+}
+
+void PixelOpsTest::benchmarkMergePlane_data()
+{
+    addInstructionSetRows();
+}
+
+void PixelOpsTest::benchmarkMergePlane()
+{
+    QFETCH(QString, instructionSet);
+    QVERIFY(PixelOps::setInstructionSet(instructionSet.toLatin1().constData()));
+    const QByteArray plane = randomBytes(BENCHMARK_BYTES, 5);
+    QByteArray rgb(BENCHMARK_BYTES * 3, 0);
+    QBENCHMARK {
+        PixelOps::mergePlane(reinterpret_cast<uchar *>(rgb.data()),
+                             reinterpret_cast<const uchar *>(plane.constData()), 0, plane.size(), 8, 1);
+    }
+}
+
+QTEST_GUILESS_MAIN(PixelOpsTest)
+
+#include "ksanepixelopstest.moc"
@@ -0,0 +1,392 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#include "ksaneselectiondetector.h"
+
+#include <QtTest>
+#include <QImage>
+#include <QList>
+#include <QRectF>
+#include <QVector>
+
+#include <math.h>
+
+using namespace KSaneIface;
+
+// The constants of the selection search
+static const int DIFF_TRIGGER = 8;
+static const int SUM_TRIGGER = 4;
+static const int AVERAGE_TRIGGER = 7;
+static const int SEL_MARGIN = 3;
+static const int MAX_NUM_SELECTIONS = 8;
+static const int AVERAGE_COUNT = 50;
+static const int AVERAGE_MULT = 49;
+static const float MIN_AREA_SIZE = 0.01;
+
+// The reduction area KSaneViewer uses
+static const float SEARCH_AREA = 10000.0;
+
+/** The edge strength of a pixel as the old search computed it. */
+static int referenceDiff(const QImage &img, int x, int y)
+{
+    int pix = qGray(img.pixel(x, y));
+    int diff = 0;
+    diff += qAbs(pix - qGray(img.pixel(x - 1, y)));
+    diff += qAbs(pix - qGray(img.pixel(x + 1, y)));
+    diff += qAbs(pix - qGray(img.pixel(x, y - 1)));
+    diff += qAbs(pix - qGray(img.pixel(x, y + 1)));
+    return diff;
+}
+
+/** KSaneViewer::refineRow() before the edge map. */
+static int referenceRefineRow(const QImage &img, int fromRow, int toRow, int colStart, int colEnd)
+{
+    int diff;
+    float rowTrigger;
+    int row;
+    int addSub = (fromRow < toRow) ? 1 : -1;
+
+    colStart -= 2;
+    colEnd += 2;
+    if (colStart < 1) {
+        colStart = 1;
+    }
+    if (colEnd >= img.width() - 1) {
+        colEnd = img.width() - 2;
+    }
+    fromRow = qBound(1, fromRow, img.height() - 2);
+    toRow = qBound(1, toRow, img.height() - 2);
+
+    row = fromRow;
+    while (row != toRow) {
+        rowTrigger = 0;
+        for (int w = colStart; w < colEnd; w++) {
+            diff = referenceDiff(img, w, row);
+            if (diff <= DIFF_TRIGGER) {
+                diff = 0;
+            }
+            rowTrigger = ((rowTrigger * AVERAGE_MULT) + diff) / AVERAGE_COUNT;
+            if (rowTrigger > AVERAGE_TRIGGER) {
+                break;
+            }
+        }
+        if (rowTrigger > AVERAGE_TRIGGER) {
+            if (row == 1) {
+                row = 0;
+            }
+            if (row == (img.width() - 2)) {
+                row = img.width();
+            }
+            return row;
+        }
+        row += addSub;
+    }
+    return row;
+}
+
+/** KSaneViewer::refineColumn() before the edge map. */
+static int referenceRefineColumn(const QImage &img, int fromCol, int toCol, int rowStart, int rowEnd)
+{
+    int diff;
+    float colTrigger;
+    int col;
+    int addSub = (fromCol < toCol) ? 1 : -1;
+
+    rowStart -= 2;
+    rowEnd += 2;
+    if (rowStart < 1) {
+        rowStart = 1;
+    }
+    if (rowEnd >= img.height() - 1) {
+        rowEnd = img.height() - 2;
+    }
+    fromCol = qBound(1, fromCol, img.width() - 2);
+    toCol = qBound(1, toCol, img.width() - 2);
+
+    col = fromCol;
+    while (col != toCol) {
+        colTrigger = 0;
+        for (int row = rowStart; row < rowEnd; row++) {
+            diff = referenceDiff(img, col, row);
+            if (diff <= DIFF_TRIGGER) {
+                diff = 0;
+            }
+            colTrigger = ((colTrigger * AVERAGE_MULT) + diff) / AVERAGE_COUNT;
+            if (colTrigger > AVERAGE_TRIGGER) {
+                break;
+            }
+        }
+        if (colTrigger > AVERAGE_TRIGGER) {
+            if (col == 1) {
+                col = 0;
+            }
+            if (col == (img.width() - 2)) {
+                col = img.width();
+            }
+            return col;
+        }
+        col += addSub;
+    }
+    return col;
+}
+
+/** KSaneViewer::findSelections() before the gray plane and the edge map,
+ * with QImage::pixel() and qGray() for every neighbour.
+ * @param found is set to the number of selections before the size checks. */
+static QList<QRectF> referenceFindSelections(const QImage &image, float area, int &found)
+{
+    QList<QRectF> selections;
+    float multiplier = sqrt(area / (image.height() * image.width()));
+    int width  = (int)(image.width() * multiplier);
+    int height = (int)(image.height() * multiplier);
+
+    QImage img = image.scaled(width, height, Qt::KeepAspectRatio);
+    height = img.height();
+    width  = img.width();
+
+    QVector<qint64> colSums(width + SEL_MARGIN + 1);
+    qint64 rowSum;
+    colSums.fill(0);
+    int pix;
+    int diff;
+    int hSelStart = -1;
+    int hSelEnd = -1;
+    int hSelMargin = 0;
+    int wSelStart = -1;
+    int wSelEnd = -1;
+    int wSelMargin = 0;
+
+    for (int h = 1; h < height; h++) {
+        rowSum = 0;
+        if (h < height - 1) {
+            // the left most pixel
+            pix = qGray(img.pixel(0, h));
+            diff  = qAbs(pix - qGray(img.pixel(1, h)));
+            diff += qAbs(pix - qGray(img.pixel(0, h - 1)));
+            diff += qAbs(pix - qGray(img.pixel(0, h + 1)));
+            if (diff > DIFF_TRIGGER) {
+                colSums[0] += diff;
+                rowSum += diff;
+            }
+            // the right most pixel
+            pix = qGray(img.pixel(width - 1, h));
+            diff  = qAbs(pix - qGray(img.pixel(width - 2, h)));
+            diff += qAbs(pix - qGray(img.pixel(width - 1, h - 1)));
+            diff += qAbs(pix - qGray(img.pixel(width - 1, h + 1)));
+            if (diff > DIFF_TRIGGER) {
+                colSums[width - 1] += diff;
+                rowSum += diff;
+            }
+            for (int w = 1; w < (width - 1); w++) {
+                diff = referenceDiff(img, w, h);
+                if (diff > DIFF_TRIGGER) {
+                    colSums[w] += diff;
+                    rowSum += diff;
+                }
+            }
+        }
+
+        if ((rowSum / width) > SUM_TRIGGER) {
+            if (hSelStart < 0) {
+                if (hSelMargin < SEL_MARGIN) {
+                    hSelMargin++;
+                }
+                if (hSelMargin == SEL_MARGIN) {
+                    hSelStart = h - SEL_MARGIN + 1;
+                }
+            }
+        } else {
+            if ((hSelStart >= 0) && (hSelMargin > 0)) {
+                hSelMargin--;
+            }
+            if ((hSelStart > -1) && ((hSelMargin == 0) || (h == height - 1))) {
+                hSelEnd = (h == height - 1) ? h - hSelMargin : h - SEL_MARGIN;
+                for (int w = 0; w <= width; w++) {
+                    if ((colSums[w] / (h - hSelStart)) > SUM_TRIGGER) {
+                        if (wSelStart < 0) {
+                            if (wSelMargin < SEL_MARGIN) {
+                                wSelMargin++;
+                            }
+                            if (wSelMargin == SEL_MARGIN) {
+                                wSelStart = w - SEL_MARGIN + 1;
+                            }
+                        }
+                    } else {
+                        if ((wSelStart >= 0) && (wSelMargin > 0)) {
+                            wSelMargin--;
+                        }
+                        if ((wSelStart >= 0) && ((wSelMargin == 0) || (w == width))) {
+                            wSelEnd = (w == width) ? width : w - SEL_MARGIN + 1;
+                            if ((wSelEnd - wSelStart) < width) {
+                                int x1 = wSelStart / multiplier;
+                                int y1 = hSelStart / multiplier;
+                                int x2 = wSelEnd / multiplier;
+                                int y2 = hSelEnd / multiplier;
+                                float selArea = (float)(wSelEnd - wSelStart) * (float)(hSelEnd - hSelStart);
+                                if (selArea > (area * MIN_AREA_SIZE)) {
+                                    // SelectionItem::setRect() normalizes
+                                    selections.append(QRectF(QRect(QPoint(x1, y1), QPoint(x2, y2))).normalized());
+                                }
+                            }
+                            wSelStart = -1;
+                            wSelEnd = -1;
+                            wSelMargin = 0;
+                        }
+                    }
+                }
+                hSelStart = -1;
+                hSelEnd = -1;
+                hSelMargin = 0;
+                colSums.fill(0);
+            }
+        }
+    }
+
+    found = selections.size();
+    if (selections.size() > MAX_NUM_SELECTIONS) {
+        return QList<QRectF>();
+    }
+
+    // refineSelections()
+    const int pixelMargin = qRound(1 / multiplier);
+    for (int i = 0; i < selections.size(); i++) {
+        const QRectF selRect = selections.at(i);
+        int top = (int)selRect.top();
+        int bottom = (int)selRect.bottom();
+        int left = (int)selRect.left();
+        int right = (int)selRect.right();
+        top = referenceRefineRow(image, top - pixelMargin, bottom, left, right);
+        bottom = referenceRefineRow(image, bottom + pixelMargin, top, left, right);
+        left = referenceRefineColumn(image, left - pixelMargin, right, top, bottom);
+        right = referenceRefineColumn(image, right + pixelMargin, left, top, bottom);
+        selections[i] = QRectF(QPointF(left, top), QPointF(right, bottom)).normalized();
+    }
+
+    float minArea = image.height() * image.width() * MIN_AREA_SIZE;
+    int i = 0;
+    while (i < selections.size()) {
+        if ((selections[i].width() * selections[i].height()) < minArea) {
+            selections.removeAt(i);
+        } else {
+            i++;
+        }
+    }
+    return selections;
+}
+
+// The size of a preview
+static const int LAYOUT_WIDTH  = 850;
+static const int LAYOUT_HEIGHT = 1170;
+
+/** A white scanner bed with @p noise gray levels of noise and textured photos. */
+static QImage layoutImage(const QList<QRect> &photos, int noise, uint seed)
+{
+    QImage img(LAYOUT_WIDTH, LAYOUT_HEIGHT, QImage::Format_RGB32);
+    qsrand(seed);
+    for (int y = 0; y < img.height(); ++y) {
+        for (int x = 0; x < img.width(); ++x) {
+            int gray = 255 - ((noise > 0) ? qrand() % noise : 0);
+            img.setPixel(x, y, qRgb(gray, gray, gray));
+        }
+    }
+    for (int i = 0; i < photos.size(); ++i) {
+        const QRect &photo = photos[i];
+        const int base = 40 + (i * 47) % 120;
+        for (int y = photo.top(); y <= photo.bottom(); ++y) {
+            for (int x = photo.left(); x <= photo.right(); ++x) {
+                // smooth shading with some grain, like a photo
+                int shade = base + ((x - photo.left()) * 60) / photo.width() + qrand() % 24;
+                img.setPixel(x, y, qRgb(qMin(shade + 30, 255), shade, qMax(shade - 20, 0)));
+            }
+        }
+    }
+    return img;
+}
+
+class SelectionDetectorTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testProjectionMethod_data();
+    void testProjectionMethod();
+};
+
+void SelectionDetectorTest::testProjectionMethod_data()
+{
+    QTest::addColumn<QImage>("image");
+    QTest::addColumn<int>("minFound");
+
+    QList<QRect> photos;
+    photos << QRect(60, 80, 300, 220) << QRect(470, 90, 320, 240) << QRect(120, 600, 600, 400);
+    QTest::newRow("several photos") << layoutImage(photos, 0, 1) << 3;
+
+    QTest::newRow("several photos on a grainy bed") << layoutImage(photos, 6, 2) << 3;
+    QTest::newRow("several photos on a noisy bed") << layoutImage(photos, 8, 7) << 1;
+
+    photos.clear();
+    photos << QRect(100, 100, 250, 300) << QRect(350, 100, 250, 300) << QRect(200, 650, 400, 200)
+           << QRect(200, 850, 400, 200);
+    QTest::newRow("touching photos") << layoutImage(photos, 0, 3) << 1;
+
+    photos.clear();
+    photos << QRect(0, 0, 400, 500) << QRect(500, 700, 350, 470);
+    QTest::newRow("photos at the border") << layoutImage(photos, 0, 4) << 1;
+
+    QTest::newRow("noise only") << layoutImage(QList<QRect>(), 60, 5) << 0;
+
+    photos.clear();
+    for (int row = 0; row < 4; ++row) {
+        for (int col = 0; col < 3; ++col) {
+            photos << QRect(40 + col * 270, 40 + row * 280, 200, 200);
+        }
+    }
+    QTest::newRow("more photos than selections") << layoutImage(photos, 0, 6) << MAX_NUM_SELECTIONS + 1;
+}
+
+/** The projection method gives the same selections as the search before the
+ * gray plane and the edge map. */
+void SelectionDetectorTest::testProjectionMethod()
+{
+    QFETCH(QImage, image);
+    QFETCH(int, minFound);
+
+    int found = 0;
+    const QList<QRectF> expected = referenceFindSelections(image, SEARCH_AREA, found);
+    // the layout must reach the part of the search it is made for
+    QVERIFY2(found >= minFound, qPrintable(QStringLiteral("%1 selections").arg(found)));
+
+    KSaneSelectionDetector detector;
+    detector.setReductionArea(SEARCH_AREA);
+    detector.setMethod(KSaneSelectionDetector::ProjectionMethod);
+    QCOMPARE(detector.detectPixels(image), expected);
+}
+
+QTEST_GUILESS_MAIN(SelectionDetectorTest)
+
+#include "ksaneselectiondetectortest.moc"
@@ -0,0 +1,224 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#include "ksanewidget.h"
+
+#include <QtTest>
+#include <QByteArray>
+#include <QImage>
+
+using namespace KSaneIface;
+
+Q_DECLARE_METATYPE(KSaneWidget::ImageFormat)
+
+static QByteArray randomBytes(int size, uint seed)
+{
+    QByteArray data(size, 0);
+    qsrand(seed);
+    for (int i = 0; i < size; ++i) {
+        data[i] = (char)(qrand() >> 4);
+    }
+    return data;
+}
+
+static int bytesPerPixel(KSaneWidget::ImageFormat format)
+{
+    switch (format) {
+    case KSaneWidget::FormatGrayScale16:
+        return 2;
+    case KSaneWidget::FormatRGB_8_C:
+        return 3;
+    case KSaneWidget::FormatRGB_16_C:
+        return 6;
+    default:
+        return 1;
+    }
+}
+
+/** The conversion of toQImageSilent() before it was split into bands. */
+static QImage referenceImage(const QByteArray &data, int width, int height, KSaneWidget::ImageFormat format)
+{
+    QImage img(width, height, QImage::Format_RGB32);
+    QRgb *imgLine;
+    int dI = ((format == KSaneWidget::FormatGrayScale16) || (format == KSaneWidget::FormatRGB_16_C)) ? 1 : 0;
+    const int step = bytesPerPixel(format);
+    const bool color = (format == KSaneWidget::FormatRGB_8_C) || (format == KSaneWidget::FormatRGB_16_C);
+    const int channelStep = step / 3;
+    for (int i = 0; (i < img.height() && dI < data.size()); i++) {
+        imgLine = reinterpret_cast<QRgb *>(img.scanLine(i));
+        for (int j = 0; (j < img.width() && dI < data.size()); j++) {
+            if (color) {
+                imgLine[j] = qRgb(data[dI], data[dI + channelStep], data[dI + 2 * channelStep]);
+            } else {
+                imgLine[j] = qRgb(data[dI], data[dI], data[dI]);
+            }
+            dI += step;
+        }
+    }
+    return img;
+}
+
+class KSaneWidgetTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testToQImageSilent_data();
+    void testToQImageSilent();
+    void benchmarkToQImageSilent_data();
+    void benchmarkToQImageSilent();
+
+    void testToQImageView_data();
+    void testToQImageView();
+
+private:
+    KSaneWidget *m_widget;
+};
+
+void KSaneWidgetTest::initTestCase()
+{
+    m_widget = new KSaneWidget();
+}
+
+void KSaneWidgetTest::cleanupTestCase()
+{
+    delete m_widget;
+}
+
+static void addFormatRows(int width, int height, const char *size)
+{
+    const KSaneWidget::ImageFormat formats[4] = {
+        KSaneWidget::FormatGrayScale8, KSaneWidget::FormatGrayScale16,
+        KSaneWidget::FormatRGB_8_C, KSaneWidget::FormatRGB_16_C
+    };
+    const char *const names[4] = { "gray 8", "gray 16", "rgb 8", "rgb 16" };
+    for (int i = 0; i < 4; ++i) {
+        QTest::newRow(qPrintable(QStringLiteral("%1 %2").arg(QLatin1String(names[i]), QLatin1String(size))))
+                << formats[i] << width << height;
+    }
+}
+
+void KSaneWidgetTest::testToQImageSilent_data()
+{
+    QTest::addColumn<KSaneWidget::ImageFormat>("format");
+    QTest::addColumn<int>("width");
+    QTest::addColumn<int>("height");
+    // converted in one thread, and in parallel bands with a partial last band
+    addFormatRows(101, 37, "small");
+    addFormatRows(723, 1001, "large");
+}
+
+void KSaneWidgetTest::testToQImageSilent()
+{
+    QFETCH(KSaneWidget::ImageFormat, format);
+    QFETCH(int, width);
+    QFETCH(int, height);
+
+    const int bytesPerLine = width * bytesPerPixel(format);
+    const QByteArray data = randomBytes(bytesPerLine * height, width);
+    QImage img = m_widget->toQImageSilent(data, width, height, bytesPerLine, format);
+    QCOMPARE(img.format(), QImage::Format_RGB32);
+    QCOMPARE(img.size(), QSize(width, height));
+    QImage expected = referenceImage(data, width, height, format);
+    for (int line = 0; line < height; ++line) {
+        QVERIFY2(memcmp(img.constScanLine(line), expected.constScanLine(line), width * 4) == 0,
+                 qPrintable(QStringLiteral("line %1").arg(line)));
+    }
+}
+
+void KSaneWidgetTest::benchmarkToQImageSilent_data()
+{
+    QTest::addColumn<KSaneWidget::ImageFormat>("format");
+    QTest::addColumn<int>("width");
+    QTest::addColumn<int>("height");
+    // an A4 page at 300 dpi
+    addFormatRows(2480, 3508, "A4 300 dpi");
+}
+
+void KSaneWidgetTest::benchmarkToQImageSilent()
+{
+    QFETCH(KSaneWidget::ImageFormat, format);
+    QFETCH(int, width);
+    QFETCH(int, height);
+
+    const int bytesPerLine = width * bytesPerPixel(format);
+    const QByteArray data = randomBytes(bytesPerLine * height, 9);
+    QImage img;
+    QBENCHMARK {
+        img = m_widget->toQImageSilent(data, width, height, bytesPerLine, format);
+    }
+    QCOMPARE(img.size(), QSize(width, height));
+}
+
+void KSaneWidgetTest::testToQImageView_data()
+{
+    QTest::addColumn<KSaneWidget::ImageFormat>("format");
+    QTest::addColumn<int>("bytesPerLine");
+    QTest::addColumn<bool>("shared");
+    QTest::newRow("mono") << KSaneWidget::FormatBlackWhite << 4 << false;
+    QTest::newRow("gray 8") << KSaneWidget::FormatGrayScale8 << 20 << true;
+    QTest::newRow("rgb 8") << KSaneWidget::FormatRGB_8_C << 60 << true;
+}
+
+/** The view must not change the caller's data and must outlive it. */
+void KSaneWidgetTest::testToQImageView()
+{
+    QFETCH(KSaneWidget::ImageFormat, format);
+    QFETCH(int, bytesPerLine);
+    QFETCH(bool, shared);
+
+    const int width = 20;
+    const int height = 10;
+    QByteArray data = randomBytes(bytesPerLine * height, 10);
+    const QByteArray original = data;
+    QImage view = m_widget->toQImageView(data, width, height, bytesPerLine, format);
+    QCOMPARE(view.size(), QSize(width, height));
+    QCOMPARE(view.constBits() == reinterpret_cast<const uchar *>(data.constData()), shared);
+    const QRgb pixel = view.pixel(3, 4);
+
+    QImage modified = view;
+    if (format == KSaneWidget::FormatBlackWhite) {
+        // Format_Mono takes the index into the color table
+        modified.setPixel(3, 4, (pixel == qRgb(0, 0, 0)) ? 0 : 1);
+    } else {
+        modified.setPixel(3, 4, qRgb(255 - qRed(pixel), 255 - qGreen(pixel), 255 - qBlue(pixel)));
+    }
+    QVERIFY(modified.pixel(3, 4) != pixel);
+    QCOMPARE(data, original);
+    QCOMPARE(view.pixel(3, 4), pixel);
+
+    data = QByteArray(data.size(), 0);
+    QCOMPARE(view.pixel(3, 4), pixel);
+}
+
+QTEST_MAIN(KSaneWidgetTest)
+
+#include "ksanewidgettest.moc"
@@ -0,0 +1,94 @@
+/* ============================================================
+*
+* This file is part of the KDE project
+*
+* Date        : 2026-10-17
+* Description : Sane interface for KDE
+*
+* Copyright (C) 2026 by the KSane developers
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) version 3, or any
+* later version accepted by the membership of KDE e.V. (or its
+* successor approved by the membership of KDE e.V.), which shall
+* act as a proxy defined in Section 6 of version 3 of the license.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+* ============================================================ */
+
+#include "ksanechunkring.h"
+
+namespace KSaneIface
+{
+
+KSaneChunkRing::KSaneChunkRing(int chunks, int chunkSize):
+    m_chunks(qMax(chunks, 2)),
+    m_head(0),
+    m_tail(0)
+{
+    for (int i = 0; i < m_chunks.size(); ++i) {
+        m_chunks[i].data.resize(chunkSize);
+        m_chunks[i].bytes = 0;
+        m_chunks[i].frame = 0;
+    }
+}
+
+void KSaneChunkRing::reset()
+{
+    m_head.storeRelease(0);
+    m_tail.storeRelease(0);
+}
+
+bool KSaneChunkRing::isEmpty() const
+{
+    return m_head.loadAcquire() == m_tail.loadAcquire();
+}
+
+KSaneChunkRing::Chunk *KSaneChunkRing::writeChunk()
+{
+    int head = m_head.load();
+    int next = (head + 1) % m_chunks.size();
+    if (next == m_tail.loadAcquire()) {
+        return 0;
+    }
+    return &m_chunks[head];
+}
+
+void KSaneChunkRing::commitWrite()
+{
+    m_head.storeRelease((m_head.load() + 1) % m_chunks.size());
+}
+
+qint64 KSaneChunkRing::memoryUsage() const
+{
+    qint64 bytes = 0;
+    for (int i = 0; i < m_chunks.size(); ++i) {
+        bytes += m_chunks[i].data.capacity();
+    }
+    return bytes;
+}
+
+KSaneChunkRing::Chunk *KSaneChunkRing::readChunk()
+{
+    int tail = m_tail.load();
+    if (tail == m_head.loadAcquire()) {
+        return 0;
+    }
+    return &m_chunks[tail];
+}
+
+void KSaneChunkRing::commitRead()
+{
+    m_tail.storeRelease((m_tail.load() + 1) % m_chunks.size());
+}
+
+}  // NameSpace KSaneIface
@@ -0,0 +1,82 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+#ifndef KSANE_CHUNK_RING_H
+#define KSANE_CHUNK_RING_H
+
+// Sane includes
+extern "C"
+{
+#include <sane/saneopts.h>
+#include <sane/sane.h>
+}
+
+#include <QAtomicInt>
+#include <QVector>
+
+namespace KSaneIface
+{
+
+/** A fixed pool of read buffers shared by exactly one producer thread and
+ * one consumer thread. The indexes are only updated with acquire/release
+ * atomics, so neither side ever takes a lock. One slot is always left
+ * empty to tell a full ring from an empty one. */
+class KSaneChunkRing
+{
+public:
+    struct Chunk {
+        QVector<SANE_Byte> data;   ///< may be grown by the producer
+        int                bytes;  ///< number of valid bytes in data
+        int                frame;  ///< frame index of a multi-pass scan
+        SANE_Parameters    params; ///< parameters of the frame the data belongs to
+    };
+
+    KSaneChunkRing(int chunks, int chunkSize);
+
+    /** Empty the ring. Must not be called while either side is active. */
+    void reset();
+    bool isEmpty() const;
+
+    /** Producer side: returns the next free chunk or 0 if the ring is full. */
+    Chunk *writeChunk();
+    void commitWrite();
+    /** Producer side: the number of bytes allocated for all chunks. */
+    qint64 memoryUsage() const;
+
+    /** Consumer side: returns the oldest filled chunk or 0 if the ring is empty. */
+    Chunk *readChunk();
+    void commitRead();
+
+private:
+    QVector<Chunk> m_chunks;
+    QAtomicInt     m_head; ///< next slot to write, only stored by the producer
+    QAtomicInt     m_tail; ///< next slot to read, only stored by the consumer
+};
+
+}
+
+#endif
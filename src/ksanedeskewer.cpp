@@ -0,0 +1,228 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#include "ksanedeskewer.h"
+
+#include <QtMath>
+
+#include <math.h>
+#include <string.h>
+
+// The fraction bits of the fixed point sample positions
+static const int FIX_BITS = 32;
+static const qint64 FIX_ONE = Q_INT64_C(1) << FIX_BITS;
+
+// The input lines are moved to the start of the window when this many bytes are unused
+static const int WINDOW_COMPACT_BYTES = 4 * 1024 * 1024;
+
+namespace KSaneIface
+{
+
+KSaneDeskewer::KSaneDeskewer():
+    m_width(0),
+    m_height(0),
+    m_depth(8),
+    m_channels(1),
+    m_lineBytes(0),
+    m_cos(1),
+    m_sin(0),
+    m_reach(0),
+    m_inputLines(0),
+    m_outputLines(0),
+    m_windowOffset(0),
+    m_windowFirst(0)
+{}
+
+bool KSaneDeskewer::canDeskew(int depth, int height)
+{
+    return ((depth == 8) || (depth == 16)) && (height > 0);
+}
+
+void KSaneDeskewer::begin(int width, int height, int depth, int channels, int lineBytes, qreal angle)
+{
+    m_width     = width;
+    m_height    = height;
+    m_depth     = depth;
+    m_channels  = channels;
+    m_lineBytes = lineBytes;
+    m_cos       = cos(qDegreesToRadians(angle));
+    m_sin       = sin(qDegreesToRadians(angle));
+    // an output line crosses the input lines +-reach around its center
+    m_reach     = (width / 2.0 + 1) * qAbs(m_sin);
+    m_inputLines   = 0;
+    m_outputLines  = 0;
+    m_window.clear();
+    m_windowOffset = 0;
+    m_windowFirst  = 0;
+}
+
+int KSaneDeskewer::outputLines() const
+{
+    return m_outputLines;
+}
+
+int KSaneDeskewer::firstNeededLine(int outLine) const
+{
+    qreal center = (m_height - 1) / 2.0;
+    int line = (int)floor(center + (outLine - center) * m_cos - m_reach) - 1;
+    return qBound(0, line, m_height - 1);
+}
+
+int KSaneDeskewer::lastNeededLine(int outLine) const
+{
+    qreal center = (m_height - 1) / 2.0;
+    int line = (int)ceil(center + (outLine - center) * m_cos + m_reach) + 1;
+    return qBound(0, line, m_height - 1);
+}
+
+const uchar *KSaneDeskewer::inputLine(int line) const
+{
+    return reinterpret_cast<const uchar *>(m_window.constData()) + m_windowOffset +
+           (qint64)(line - m_windowFirst) * m_lineBytes;
+}
+
+QByteArray KSaneDeskewer::addStrip(const QByteArray &strip)
+{
+    m_window.append(strip);
+    m_inputLines += strip.size() / m_lineBytes;
+    return rotateLines(m_inputLines - 1);
+}
+
+QByteArray KSaneDeskewer::finish()
+{
+    // the lines that never came are white
+    QByteArray lines = rotateLines(m_height - 1);
+    m_window.clear();
+    m_windowOffset = 0;
+    m_windowFirst  = m_inputLines;
+    return lines;
+}
+
+QByteArray KSaneDeskewer::rotateLines(int lastLine)
+{
+    int lines = 0;
+    while ((m_outputLines + lines < m_height) && (lastNeededLine(m_outputLines + lines) <= lastLine)) {
+        lines++;
+    }
+    if (lines == 0) {
+        return QByteArray();
+    }
+
+    QByteArray rotated(lines * m_lineBytes, 0);
+    uchar *out = reinterpret_cast<uchar *>(rotated.data());
+    for (int i = 0; i < lines; i++) {
+        rotateLine(m_outputLines, out);
+        out += m_lineBytes;
+        m_outputLines++;
+    }
+
+    // drop the input lines the next output lines do not need
+    if (m_outputLines < m_height) {
+        int first = qMin(firstNeededLine(m_outputLines), m_inputLines);
+        if (first > m_windowFirst) {
+            m_windowOffset += (first - m_windowFirst) * m_lineBytes;
+            m_windowFirst = first;
+        }
+        if (m_windowOffset >= WINDOW_COMPACT_BYTES) {
+            m_window.remove(0, m_windowOffset);
+            m_windowOffset = 0;
+        }
+    }
+    return rotated;
+}
+
+static inline int readSample(const uchar *p, int bytes)
+{
+    if (bytes == 1) {
+        return p[0];
+    }
+    // SANE delivers 16 bit samples in the byte order of the host
+    quint16 sample;
+    memcpy(&sample, p, sizeof(sample));
+    return sample;
+}
+
+static inline void writeSample(uchar *p, int bytes, int value)
+{
+    if (bytes == 1) {
+        p[0] = (uchar)value;
+        return;
+    }
+    quint16 sample = (quint16)value;
+    memcpy(p, &sample, sizeof(sample));
+}
+
+void KSaneDeskewer::rotateLine(int outLine, uchar *out) const
+{
+    const int sampleBytes = m_depth / 8;
+    const int pixelBytes  = sampleBytes * m_channels;
+    const int white       = (1 << m_depth) - 1;
+    const int lastX       = m_width - 1;
+    // only the lines that have been added can be read
+    const int lastY       = qMin(m_height, m_inputLines) - 1;
+
+    // the input position of the first pixel and the step per output pixel
+    const qreal cx = (m_width - 1) / 2.0;
+    const qreal cy = (m_height - 1) / 2.0;
+    const qreal dy = outLine - cy;
+    qint64 fx = (qint64)floor((cx - cx * m_cos - dy * m_sin) * FIX_ONE + 0.5);
+    qint64 fy = (qint64)floor((cy - cx * m_sin + dy * m_cos) * FIX_ONE + 0.5);
+    const qint64 stepX = (qint64)floor(m_cos * FIX_ONE + 0.5);
+    const qint64 stepY = (qint64)floor(m_sin * FIX_ONE + 0.5);
+
+    const qint64 maxX = (qint64)lastX << FIX_BITS;
+    const qint64 maxY = (qint64)lastY << FIX_BITS;
+
+    for (int x = 0; x < m_width; x++, fx += stepX, fy += stepY, out += pixelBytes) {
+        if ((fx < 0) || (fy < 0) || (fx > maxX) || (fy > maxY)) {
+            for (int c = 0; c < m_channels; c++) {
+                writeSample(out + c * sampleBytes, sampleBytes, white);
+            }
+            continue;
+        }
+
+        // bilinear interpolation with 8 bit weights
+        const int ix = (int)(fx >> FIX_BITS);
+        const int iy = (int)(fy >> FIX_BITS);
+        const quint32 wx = (quint32)(fx >> (FIX_BITS - 8)) & 0xFF;
+        const quint32 wy = (quint32)(fy >> (FIX_BITS - 8)) & 0xFF;
+        const uchar *top    = inputLine(iy) + ix * pixelBytes;
+        const uchar *bottom = inputLine(qMin(iy + 1, lastY)) + ix * pixelBytes;
+        const int    right  = (ix < lastX) ? pixelBytes : 0;
+        for (int c = 0; c < m_channels; c++) {
+            const int offset = c * sampleBytes;
+            quint32 upper = readSample(top + offset, sampleBytes) * (256 - wx) +
+                            readSample(top + offset + right, sampleBytes) * wx;
+            quint32 lower = readSample(bottom + offset, sampleBytes) * (256 - wx) +
+                            readSample(bottom + offset + right, sampleBytes) * wx;
+            writeSample(out + offset, sampleBytes, (int)((upper * (256 - wy) + lower * wy + 32768) >> 16));
+        }
+    }
+}
+
+}  // NameSpace KSaneIface
@@ -0,0 +1,91 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#ifndef KSANE_DESKEWER_H
+#define KSANE_DESKEWER_H
+
+#include <QByteArray>
+
+namespace KSaneIface
+{
+
+/** Rotates the lines of a final scan back by the skew of its content while
+ * the lines arrive. An output line only needs the input lines its rotated
+ * copy crosses, so only a window of input lines is kept. The rotation is
+ * about the center of the image and keeps its size, the corners that come
+ * from outside the image are white. */
+class KSaneDeskewer
+{
+public:
+    KSaneDeskewer();
+
+    /** @return true if images with this depth and height can be rotated. */
+    static bool canDeskew(int depth, int height);
+
+    /** Start rotating a new image.
+     * @param width is the width in pixels.
+     * @param height is the number of lines.
+     * @param depth is the number of bits per sample (8 or 16).
+     * @param channels is 1 for gray and 3 for RGB.
+     * @param lineBytes is the number of bytes per line in the strips.
+     * @param angle is the skew in degrees, positive is clockwise. */
+    void begin(int width, int height, int depth, int channels, int lineBytes, qreal angle);
+    /** Add complete input lines.
+     * @return the output lines that could be completed, possibly none. */
+    QByteArray addStrip(const QByteArray &strip);
+    /** No more input lines will come.
+     * @return the rest of the output lines. */
+    QByteArray finish();
+    /** @return the number of output lines returned so far. */
+    int outputLines() const;
+
+private:
+    int firstNeededLine(int outLine) const;
+    int lastNeededLine(int outLine) const;
+    QByteArray rotateLines(int lastLine);
+    void rotateLine(int outLine, uchar *out) const;
+    const uchar *inputLine(int line) const;
+
+    int        m_width;
+    int        m_height;
+    int        m_depth;
+    int        m_channels;
+    int        m_lineBytes;
+    qreal      m_cos;
+    qreal      m_sin;
+    qreal      m_reach;         ///< how far the lines spread vertically from the center
+    int        m_inputLines;    ///< input lines added so far
+    int        m_outputLines;   ///< output lines returned so far
+    QByteArray m_window;        ///< the input lines still needed
+    int        m_windowOffset;  ///< the byte offset of the first line in m_window
+    int        m_windowFirst;   ///< the input line at m_windowOffset
+};
+
+}
+
+#endif
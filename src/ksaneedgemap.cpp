@@ -0,0 +1,76 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#include "ksaneedgemap.h"
+
+#include "ksanepixelops.h"
+
+namespace KSaneIface
+{
+
+KSaneEdgeMap::KSaneEdgeMap(const QImage &img, int trigger):
+    m_img(img),
+    m_width(img.width()),
+    m_height(img.height()),
+    m_trigger(trigger)
+{
+    if (m_img.format() != QImage::Format_Grayscale8) {
+        if ((m_img.format() != QImage::Format_RGB32) && (m_img.format() != QImage::Format_ARGB32)) {
+            // qGray() of QImage::pixel() gives the same values
+            m_img = m_img.convertToFormat(QImage::Format_RGB32);
+        }
+        m_gray.resize(m_height);
+    }
+    m_edges.resize(m_height);
+}
+
+const uchar *KSaneEdgeMap::grayLine(int y)
+{
+    if (m_img.format() == QImage::Format_Grayscale8) {
+        // the lines are used as they are
+        return m_img.constScanLine(y);
+    }
+    QVector<uchar> &gray = m_gray[y];
+    if (gray.isEmpty()) {
+        gray.resize(m_width);
+        PixelOps::rgb32ToGray(gray.data(), reinterpret_cast<const quint32 *>(m_img.constScanLine(y)), m_width);
+    }
+    return gray.constData();
+}
+
+void KSaneEdgeMap::computeLine(int y)
+{
+    const uchar *above = grayLine(y - 1);
+    const uchar *gray = grayLine(y);
+    const uchar *below = grayLine(y + 1);
+    QVector<quint16> &edges = m_edges[y];
+    edges.resize(m_width);
+    PixelOps::edgeStrength(edges.data(), above, gray, below, m_width, m_trigger);
+}
+
+}  // NameSpace KSaneIface
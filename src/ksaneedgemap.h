@@ -0,0 +1,79 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#ifndef KSANE_EDGE_MAP_H
+#define KSANE_EDGE_MAP_H
+
+#include <QImage>
+#include <QVector>
+
+namespace KSaneIface
+{
+
+/** The edge strength of every pixel of an image: the sum of the gray level
+ * differences to the four neighbours, or 0 if the sum is not above the
+ * trigger. The gray lines and the edge lines are allocated and computed
+ * on first use, so only the lines that are looked at cost anything. */
+class KSaneEdgeMap
+{
+public:
+    KSaneEdgeMap(const QImage &img, int trigger);
+
+    int width() const {
+        return m_width;
+    }
+    int height() const {
+        return m_height;
+    }
+
+    /** @return the edge strengths of line @p y. The first and the last line
+     * have no neighbour above or below, so 1 <= y < height() - 1.
+     * The width must be at least 2. */
+    const quint16 *line(int y) {
+        if (m_edges[y].isEmpty()) {
+            computeLine(y);
+        }
+        return m_edges[y].constData();
+    }
+
+private:
+    void computeLine(int y);
+    const uchar *grayLine(int y);
+
+    QImage          m_img;
+    int             m_width;
+    int             m_height;
+    int             m_trigger;
+    // one vector per line, empty until the line is computed
+    QVector<QVector<uchar> >   m_gray;
+    QVector<QVector<quint16> > m_edges;
+};
+
+}
+
+#endif
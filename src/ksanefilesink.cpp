@@ -0,0 +1,159 @@
+/* ============================================================
+*
+* This file is part of the KDE project
+*
+* Date        : 2026-10-17
+* Description : Sane interface for KDE
+*
+* Copyright (C) 2026 by the KSane developers
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) version 3, or any
+* later version accepted by the membership of KDE e.V. (or its
+* successor approved by the membership of KDE e.V.), which shall
+* act as a proxy defined in Section 6 of version 3 of the license.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+* ============================================================ */
+
+#include "ksanefilesink.h"
+
+#include <QTemporaryFile>
+#include <QDir>
+#include <QDebug>
+
+// initial mapping when the image size is not known
+#define FILE_SINK_MIN_SIZE (16 * 1024 * 1024)
+
+namespace KSaneIface
+{
+
+KSaneFileSink::KSaneFileSink():
+    m_file(0),
+    m_map(0),
+    m_mapSize(0)
+{}
+
+KSaneFileSink::~KSaneFileSink()
+{
+    unmap();
+    delete m_file;
+}
+
+bool KSaneFileSink::open(const QString &fileName, qint64 size)
+{
+    unmap();
+    delete m_file;
+    m_file = 0;
+
+    if (fileName.isEmpty()) {
+        QTemporaryFile *tmpFile = new QTemporaryFile(QDir::tempPath() + QStringLiteral("/ksane_XXXXXX.raw"));
+        // the receiver of the image owns the file
+        tmpFile->setAutoRemove(false);
+        m_file = tmpFile;
+        if (!tmpFile->open()) {
+            qDebug() << "Could not create a temporary scan file:" << m_file->errorString();
+            return false;
+        }
+    } else {
+        m_file = new QFile(fileName);
+        if (!m_file->open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+            qDebug() << "Could not open" << fileName << ":" << m_file->errorString();
+            return false;
+        }
+    }
+
+    if (!map((size > 0) ? size : FILE_SINK_MIN_SIZE)) {
+        // do not leave a large empty file behind
+        discard();
+        return false;
+    }
+    return true;
+}
+
+uchar *KSaneFileSink::reserve(qint64 size)
+{
+    if (size <= m_mapSize) {
+        return m_map;
+    }
+    if (!map(qMax(size, m_mapSize * 2))) {
+        return 0;
+    }
+    return m_map;
+}
+
+void KSaneFileSink::close(qint64 size)
+{
+    if (!m_file) {
+        return;
+    }
+    unmap();
+    m_file->resize(size);
+    m_file->close();
+}
+
+void KSaneFileSink::discard()
+{
+    if (!m_file) {
+        return;
+    }
+    unmap();
+    m_file->remove();
+}
+
+uchar *KSaneFileSink::data() const
+{
+    return m_map;
+}
+
+qint64 KSaneFileSink::mappedSize() const
+{
+    return m_mapSize;
+}
+
+QString KSaneFileSink::fileName() const
+{
+    return m_file ? m_file->fileName() : QString();
+}
+
+QString KSaneFileSink::errorString() const
+{
+    return m_file ? m_file->errorString() : QString();
+}
+
+bool KSaneFileSink::map(qint64 size)
+{
+    unmap();
+    if (!m_file->resize(size)) {
+        qDebug() << "Could not resize" << m_file->fileName() << "to" << size << ":" << m_file->errorString();
+        return false;
+    }
+    m_map = m_file->map(0, size);
+    if (!m_map) {
+        // a 32 bit address space can not map more than a few GB
+        qDebug() << "Could not map" << size << "bytes of" << m_file->fileName() << ":" << m_file->errorString();
+        return false;
+    }
+    m_mapSize = size;
+    return true;
+}
+
+void KSaneFileSink::unmap()
+{
+    if (m_map) {
+        m_file->unmap(m_map);
+        m_map = 0;
+    }
+    m_mapSize = 0;
+}
+
+}  // NameSpace KSaneIface
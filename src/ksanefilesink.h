@@ -0,0 +1,79 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+#ifndef KSANE_FILE_SINK_H
+#define KSANE_FILE_SINK_H
+
+#include <QFile>
+#include <QString>
+
+namespace KSaneIface
+{
+
+/** Destination of a final scan that is written into a memory mapped file
+ * instead of a QByteArray. All sizes and offsets are 64 bit, so the image
+ * can be larger than the available memory and larger than 2 GB. */
+class KSaneFileSink
+{
+public:
+    KSaneFileSink();
+    ~KSaneFileSink();
+
+    /** Create (or truncate) the file and map @p size bytes of it.
+     * @param fileName is the file to write. If it is empty a temporary file is created.
+     * @param size is the expected image size or 0 if it is not known.
+     * @return true on success. */
+    bool open(const QString &fileName, qint64 size);
+
+    /** Make sure at least @p size bytes are mapped. An image of unknown size
+     * (hand scanners) grows the file geometrically.
+     * @return the start of the mapping or 0 if the file could not be grown. */
+    uchar *reserve(qint64 size);
+
+    /** Unmap and truncate the file to @p size bytes. The file is kept. */
+    void close(qint64 size);
+
+    /** Unmap and remove the file. */
+    void discard();
+
+    uchar *data() const;
+    qint64 mappedSize() const;
+    QString fileName() const;
+    QString errorString() const;
+
+private:
+    bool map(qint64 size);
+    void unmap();
+
+    QFile   *m_file;
+    uchar   *m_map;
+    qint64   m_mapSize;
+};
+
+}
+
+#endif
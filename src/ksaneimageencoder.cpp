@@ -0,0 +1,686 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#include "ksaneimageencoder.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QBuffer>
+#include <QImage>
+#include <QImageWriter>
+#include <QMutexLocker>
+#include <QDebug>
+
+#include <KLocalizedString>
+
+#include <string.h>
+
+#include "ksanepixelops.h"
+
+namespace KSaneIface
+{
+
+static void putLE16(QByteArray &data, int value)
+{
+    data.append((char)(value & 0xFF));
+    data.append((char)((value >> 8) & 0xFF));
+}
+
+static void putLE32(QByteArray &data, quint32 value)
+{
+    putLE16(data, value & 0xFFFF);
+    putLE16(data, value >> 16);
+}
+
+// TIFF files are written in the byte order of the host, so the 16 bit
+// samples can be written as SANE delivers them
+static void putTiff16(QByteArray &data, quint16 value)
+{
+    data.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void putTiff32(QByteArray &data, quint32 value)
+{
+    data.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+/** A TIFF directory entry. SHORT values that fit are stored in the first two bytes. */
+static void putTiffEntry(QByteArray &data, int tag, int type, quint32 count, quint32 value)
+{
+    putTiff16(data, tag);
+    putTiff16(data, type);
+    putTiff32(data, count);
+    if ((type == 3) && (count == 1)) {
+        putTiff16(data, value);
+        putTiff16(data, 0);
+    } else {
+        putTiff32(data, value);
+    }
+}
+
+enum TiffType {
+    TIFF_SHORT    = 3,
+    TIFF_LONG     = 4,
+    TIFF_RATIONAL = 5
+};
+
+KSaneImageEncoder::KSaneImageEncoder():
+    m_format(KSaneWidget::EncodeNone),
+    m_output(0),
+    m_ownsOutput(false),
+    m_createdFile(false),
+    m_start(0),
+    m_imageCount(0),
+    m_dpi(0),
+    m_width(0),
+    m_height(0),
+    m_depth(0),
+    m_channels(0),
+    m_lineBytes(0),
+    m_rowBytes(0),
+    m_lines(0),
+    m_finishing(false),
+    m_completed(false),
+    m_rowsPerStrip(1),
+    m_failed(false)
+{}
+
+KSaneImageEncoder::~KSaneImageEncoder()
+{
+    finish(false);
+    wait();
+}
+
+bool KSaneImageEncoder::setOutput(KSaneWidget::EncodeFormat format, const QString &fileName, QIODevice *device)
+{
+    if (format == KSaneWidget::EncodeNone) {
+        m_format = format;
+        return true;
+    }
+    bool tiff = (format == KSaneWidget::EncodeTIFF) || (format == KSaneWidget::EncodeTIFFDeflate);
+    if (fileName.isEmpty()) {
+        if ((device == 0) && (format != KSaneWidget::EncodeBMP)) {
+            // only BMP has an ImageFormat for imageReady()
+            return false;
+        }
+        if ((device != 0) && device->isSequential() && tiff) {
+            // the directory offset is patched at the end
+            return false;
+        }
+    }
+    m_format   = format;
+    m_fileName = fileName;
+    m_device   = fileName.isEmpty() ? device : 0;
+    // a new output starts a new batch
+    m_imageCount = 0;
+    return true;
+}
+
+KSaneWidget::EncodeFormat KSaneImageEncoder::format() const
+{
+    return m_format;
+}
+
+bool KSaneImageEncoder::toMemory() const
+{
+    return (m_format != KSaneWidget::EncodeNone) && m_fileName.isEmpty() && m_device.isNull();
+}
+
+void KSaneImageEncoder::setResolution(float dpi)
+{
+    m_dpi = dpi;
+}
+
+void KSaneImageEncoder::startBatch()
+{
+    // the previous batch may still be finishing its last image
+    wait();
+    m_imageCount = 0;
+}
+
+void KSaneImageEncoder::begin(int width, int height, int depth, int channels, int lineBytes)
+{
+    // a batch scan starts the next image right after the previous one
+    wait();
+
+    m_width     = width;
+    m_height    = height;
+    m_depth     = depth;
+    m_channels  = channels;
+    m_lineBytes = lineBytes;
+    m_rowBytes  = (width * channels * depth + 7) / 8;
+    m_queue.clear();
+    m_finishing = false;
+    m_completed = false;
+    m_imageCount++;
+    start();
+}
+
+void KSaneImageEncoder::addStrip(const QByteArray &strip)
+{
+    QMutexLocker locker(&m_mutex);
+    m_queue.enqueue(strip);
+    m_dataAvailable.wakeOne();
+}
+
+void KSaneImageEncoder::finish(bool completed)
+{
+    QMutexLocker locker(&m_mutex);
+    m_finishing = true;
+    m_completed = completed;
+    m_dataAvailable.wakeOne();
+}
+
+bool KSaneImageEncoder::succeeded() const
+{
+    return !m_failed;
+}
+
+QString KSaneImageEncoder::errorString() const
+{
+    return m_errorString;
+}
+
+QByteArray KSaneImageEncoder::encodedData() const
+{
+    return m_encoded;
+}
+
+void KSaneImageEncoder::run()
+{
+    m_failed = false;
+    m_errorString.clear();
+    m_lines = 0;
+    m_pending.clear();
+    m_stripOffsets.clear();
+    m_stripBytes.clear();
+
+    if (openOutput()) {
+        writeHeader();
+    }
+
+    forever {
+        QQueue<QByteArray> strips;
+        bool finishing;
+        m_mutex.lock();
+        while (m_queue.isEmpty() && !m_finishing) {
+            m_dataAvailable.wait(&m_mutex);
+        }
+        strips.swap(m_queue);
+        // finish() is called after the last addStrip(), so all lines are in strips now
+        finishing = m_finishing;
+        m_mutex.unlock();
+
+        while (!strips.isEmpty()) {
+            QByteArray strip = strips.dequeue();
+            if (!m_failed && (m_lineBytes > 0)) {
+                writeLines(reinterpret_cast<const uchar *>(strip.constData()), strip.size() / m_lineBytes);
+            }
+        }
+        if (finishing) {
+            break;
+        }
+    }
+
+    m_mutex.lock();
+    bool completed = m_completed;
+    m_mutex.unlock();
+    if (!completed && !m_failed) {
+        m_failed = true;
+        m_errorString = i18n("The scan was not completed.");
+    }
+    if (!m_failed) {
+        writeTrailer();
+    }
+    closeOutput(!m_failed);
+    m_pending.clear();
+}
+
+QString KSaneImageEncoder::imageFileName() const
+{
+    if (m_imageCount <= 1) {
+        return m_fileName;
+    }
+    // scan.tiff, scan-2.tiff, scan-3.tiff, ...
+    QFileInfo info(m_fileName);
+    QString name = info.completeBaseName() + QLatin1Char('-') + QString::number(m_imageCount);
+    if (!info.suffix().isEmpty()) {
+        name += QLatin1Char('.') + info.suffix();
+    }
+    return info.dir().filePath(name);
+}
+
+bool KSaneImageEncoder::openOutput()
+{
+    m_ownsOutput = true;
+    m_createdFile = false;
+    if (!m_fileName.isEmpty()) {
+        QFile *file = new QFile(imageFileName());
+        m_output = file;
+        m_createdFile = !file->exists();
+        if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            // a file that could not be opened is not ours to remove
+            m_createdFile = false;
+            m_failed = true;
+            m_errorString = file->errorString();
+            return false;
+        }
+    } else if (!m_device.isNull()) {
+        m_ownsOutput = false;
+        m_output = m_device.data();
+        if (!m_output->isOpen() && !m_output->open(QIODevice::WriteOnly)) {
+            m_failed = true;
+            m_errorString = m_output->errorString();
+            return false;
+        }
+    } else {
+        m_encoded.clear();
+        QBuffer *buffer = new QBuffer(&m_encoded);
+        buffer->open(QIODevice::WriteOnly);
+        m_output = buffer;
+    }
+
+    if ((m_height <= 0) && m_output->isSequential()) {
+        // the number of lines is written into the header at the end
+        m_failed = true;
+        m_errorString = i18n("Images of unknown height need a random access output.");
+        return false;
+    }
+    return true;
+}
+
+void KSaneImageEncoder::closeOutput(bool success)
+{
+    if (m_output == 0) {
+        return;
+    }
+    if (m_ownsOutput) {
+        m_output->close();
+        QFile *file = qobject_cast<QFile *>(m_output);
+        if (file && !success && m_createdFile) {
+            file->remove();
+        }
+        delete m_output;
+    }
+    m_output = 0;
+    if (!success) {
+        m_encoded.clear();
+    }
+}
+
+bool KSaneImageEncoder::write(const QByteArray &data)
+{
+    if (m_output->write(data) != data.size()) {
+        m_failed = true;
+        m_errorString = m_output->errorString();
+        return false;
+    }
+    return true;
+}
+
+bool KSaneImageEncoder::writeAt(qint64 pos, const QByteArray &data)
+{
+    qint64 end = m_output->pos();
+    if (m_output->isSequential() || !m_output->seek(pos)) {
+        m_failed = true;
+        m_errorString = i18n("The image header can not be updated.");
+        return false;
+    }
+    bool ok = write(data);
+    m_output->seek(end);
+    return ok;
+}
+
+bool KSaneImageEncoder::writeHeader()
+{
+    if ((m_depth == 1) && (m_channels != 1)) {
+        m_failed = true;
+        m_errorString = i18n("Color line-art images can not be encoded.");
+        return false;
+    }
+    // the offsets in the headers are relative to the start of the image
+    m_start = m_output->isSequential() ? 0 : m_output->pos();
+    switch (m_format) {
+    case KSaneWidget::EncodeBMP:
+        return writeBmpHeader();
+    case KSaneWidget::EncodeTIFF:
+    case KSaneWidget::EncodeTIFFDeflate: {
+        QByteArray header((Q_BYTE_ORDER == Q_BIG_ENDIAN) ? "MM" : "II");
+        putTiff16(header, 42);
+        // the directory offset is patched in writeTiffDirectory()
+        putTiff32(header, 0);
+        m_rowsPerStrip = qMax(1, TIFF_STRIP_BYTES / qMax(m_rowBytes, 1));
+        return write(header);
+    }
+    default:
+        // PNG is written when all lines are there
+        return true;
+    }
+}
+
+bool KSaneImageEncoder::writeLines(const uchar *data, int lines)
+{
+    if (m_height > 0) {
+        // ignore anything the backend sends after the last line
+        lines = qMin(lines, m_height - m_lines);
+    }
+    if (lines <= 0) {
+        return true;
+    }
+
+    bool ok = true;
+    switch (m_format) {
+    case KSaneWidget::EncodeBMP:
+        ok = writeBmpLines(data, lines);
+        break;
+    case KSaneWidget::EncodeTIFF:
+    case KSaneWidget::EncodeTIFFDeflate:
+        for (int i = 0; (i < lines) && ok; ++i) {
+            m_pending.append(reinterpret_cast<const char *>(data + (qint64)i * m_lineBytes), m_rowBytes);
+            if (m_pending.size() >= m_rowsPerStrip * m_rowBytes) {
+                ok = flushTiffStrip();
+            }
+        }
+        break;
+    default:
+        for (int i = 0; i < lines; ++i) {
+            m_pending.append(reinterpret_cast<const char *>(data + (qint64)i * m_lineBytes), m_rowBytes);
+        }
+        break;
+    }
+    m_lines += lines;
+    return ok;
+}
+
+bool KSaneImageEncoder::writeTrailer()
+{
+    switch (m_format) {
+    case KSaneWidget::EncodeBMP:
+        return patchBmpHeader();
+    case KSaneWidget::EncodeTIFF:
+    case KSaneWidget::EncodeTIFFDeflate:
+        return flushTiffStrip() && writeTiffDirectory();
+    default:
+        return writePng();
+    }
+}
+
+// ------------------------------------------------------------------------
+// BMP: the lines are stored top-down (negative height), so they can be
+// written in the order they are scanned.
+static int bmpBits(int depth, int channels)
+{
+    return (channels == 3) ? 24 : (depth == 1) ? 1 : 8;
+}
+
+bool KSaneImageEncoder::writeBmpHeader()
+{
+    const int bits = bmpBits(m_depth, m_channels);
+    const int paletteSize = (bits == 24) ? 0 : (1 << bits);
+    const quint32 rowBytes = ((m_width * bits + 31) / 32) * 4;
+    const quint32 dataOffset = 14 + 40 + 4 * paletteSize;
+    const int height = qMax(m_height, 0);
+    const quint32 ppm = (quint32)(m_dpi * (1000.0 / 25.4) + 0.5);
+
+    QByteArray header("BM");
+    putLE32(header, dataOffset + rowBytes * height); // file size
+    putLE32(header, 0);
+    putLE32(header, dataOffset);
+    putLE32(header, 40);
+    putLE32(header, m_width);
+    putLE32(header, (quint32)(-height));
+    putLE16(header, 1);                              // planes
+    putLE16(header, bits);
+    putLE32(header, 0);                              // no compression
+    putLE32(header, rowBytes * height);
+    putLE32(header, ppm);
+    putLE32(header, ppm);
+    putLE32(header, paletteSize);
+    putLE32(header, 0);
+    if (bits == 1) {
+        // SANE line-art has 1 = black
+        putLE32(header, 0x00FFFFFF);
+        putLE32(header, 0x00000000);
+    } else {
+        for (int i = 0; i < paletteSize; ++i) {
+            putLE32(header, i * 0x010101);
+        }
+    }
+    return write(header);
+}
+
+bool KSaneImageEncoder::writeBmpLines(const uchar *data, int lines)
+{
+    const int bits = bmpBits(m_depth, m_channels);
+    const int rowBytes = ((m_width * bits + 31) / 32) * 4;
+    // 16 bit samples are in host order and truncated to their high byte
+    const int sampleBytes = m_depth / 8;
+    const int msb = (Q_BYTE_ORDER == Q_BIG_ENDIAN) ? 0 : sampleBytes - 1;
+    QByteArray rows(rowBytes * lines, 0);
+    for (int l = 0; l < lines; ++l) {
+        const uchar *src = data + (qint64)l * m_lineBytes;
+        uchar *dst = reinterpret_cast<uchar *>(rows.data()) + l * rowBytes;
+        if ((bits == 1) || ((bits == 8) && (sampleBytes == 1))) {
+            memcpy(dst, src, m_rowBytes);
+        } else if (bits == 8) {
+            for (int i = 0; i < m_width; ++i) {
+                dst[i] = src[i * 2 + msb];
+            }
+        } else {
+            for (int i = 0; i < m_width; ++i) {
+                const uchar *pixel = src + i * 3 * sampleBytes + msb;
+                dst[i * 3]     = pixel[2 * sampleBytes];
+                dst[i * 3 + 1] = pixel[sampleBytes];
+                dst[i * 3 + 2] = pixel[0];
+            }
+        }
+    }
+    return write(rows);
+}
+
+bool KSaneImageEncoder::patchBmpHeader()
+{
+    if (m_lines == m_height) {
+        return true;
+    }
+    const int bits = bmpBits(m_depth, m_channels);
+    const quint32 rowBytes = ((m_width * bits + 31) / 32) * 4;
+    const quint32 dataOffset = 14 + 40 + 4 * ((bits == 24) ? 0 : (1 << bits));
+    QByteArray value;
+    putLE32(value, dataOffset + rowBytes * m_lines);
+    if (!writeAt(m_start + 2, value)) {
+        return false;
+    }
+    value.clear();
+    putLE32(value, (quint32)(-m_lines));
+    if (!writeAt(m_start + 22, value)) {
+        return false;
+    }
+    value.clear();
+    putLE32(value, rowBytes * m_lines);
+    return writeAt(m_start + 34, value);
+}
+
+// ------------------------------------------------------------------------
+// TIFF: the strips are written as they fill up, the directory follows the
+// image data and its offset is patched into the header at the end.
+bool KSaneImageEncoder::flushTiffStrip()
+{
+    if (m_pending.isEmpty()) {
+        return true;
+    }
+    QByteArray strip = m_pending;
+    m_pending.clear();
+    if (m_format == KSaneWidget::EncodeTIFFDeflate) {
+        // qCompress() writes the uncompressed size in front of the zlib stream
+        strip = qCompress(strip);
+        strip.remove(0, 4);
+    }
+    qint64 offset = m_output->pos() - m_start;
+    if (offset + strip.size() > 0xFFFFFFFFLL) {
+        m_failed = true;
+        m_errorString = i18n("The image is too large for a TIFF file.");
+        return false;
+    }
+    m_stripOffsets.append((quint32)offset);
+    m_stripBytes.append(strip.size());
+    return write(strip);
+}
+
+bool KSaneImageEncoder::writeTiffDirectory()
+{
+    if (m_lines == 0) {
+        m_failed = true;
+        m_errorString = i18n("The image is empty.");
+        return false;
+    }
+    if ((m_output->pos() - m_start) % 2) {
+        // the directory must start on a word boundary
+        if (!write(QByteArray(1, 0))) {
+            return false;
+        }
+    }
+
+    const int entries = 13;
+    const quint32 directory = (quint32)(m_output->pos() - m_start);
+    quint32 extra = directory + 2 + entries * 12 + 4;
+    QByteArray extraData;
+    const int strips = m_stripOffsets.size();
+
+    quint32 bitsOffset = extra + extraData.size();
+    if (m_channels > 1) {
+        for (int c = 0; c < m_channels; ++c) {
+            putTiff16(extraData, m_depth);
+        }
+    }
+    quint32 offsetsOffset = extra + extraData.size();
+    quint32 bytesOffset = offsetsOffset;
+    if (strips > 1) {
+        for (int i = 0; i < strips; ++i) {
+            putTiff32(extraData, m_stripOffsets[i]);
+        }
+        bytesOffset = extra + extraData.size();
+        for (int i = 0; i < strips; ++i) {
+            putTiff32(extraData, m_stripBytes[i]);
+        }
+    }
+    // the resolution in dots per inch as a rational with two decimals
+    quint32 resolution = (m_dpi > 0) ? (quint32)(m_dpi * 100 + 0.5) : 7200;
+    quint32 resolutionOffset = extra + extraData.size();
+    putTiff32(extraData, resolution);
+    putTiff32(extraData, 100);
+
+    int photometric = (m_channels == 3) ? 2 : (m_depth == 1) ? 0 : 1;
+    QByteArray ifd;
+    putTiff16(ifd, entries);
+    putTiffEntry(ifd, 256, TIFF_LONG, 1, m_width);
+    putTiffEntry(ifd, 257, TIFF_LONG, 1, m_lines);
+    putTiffEntry(ifd, 258, TIFF_SHORT, m_channels, (m_channels > 1) ? bitsOffset : m_depth);
+    putTiffEntry(ifd, 259, TIFF_SHORT, 1, (m_format == KSaneWidget::EncodeTIFFDeflate) ? 8 : 1);
+    putTiffEntry(ifd, 262, TIFF_SHORT, 1, photometric);
+    putTiffEntry(ifd, 273, TIFF_LONG, strips, (strips > 1) ? offsetsOffset : m_stripOffsets[0]);
+    putTiffEntry(ifd, 277, TIFF_SHORT, 1, m_channels);
+    putTiffEntry(ifd, 278, TIFF_LONG, 1, m_rowsPerStrip);
+    putTiffEntry(ifd, 279, TIFF_LONG, strips, (strips > 1) ? bytesOffset : m_stripBytes[0]);
+    putTiffEntry(ifd, 282, TIFF_RATIONAL, 1, resolutionOffset);
+    putTiffEntry(ifd, 283, TIFF_RATIONAL, 1, resolutionOffset);
+    putTiffEntry(ifd, 284, TIFF_SHORT, 1, 1);   // interleaved samples
+    putTiffEntry(ifd, 296, TIFF_SHORT, 1, 2);   // resolution in inches
+    putTiff32(ifd, 0);                          // no next directory
+
+    if (!write(ifd) || !write(extraData)) {
+        return false;
+    }
+    QByteArray offset;
+    putTiff32(offset, directory);
+    return writeAt(m_start + 4, offset);
+}
+
+// ------------------------------------------------------------------------
+// PNG: QImageWriter needs the whole image, so the lines are collected.
+bool KSaneImageEncoder::writePng()
+{
+    QImage img;
+    const uchar *src = reinterpret_cast<const uchar *>(m_pending.constData());
+    if (m_depth == 1) {
+        img = QImage(m_width, m_lines, QImage::Format_Mono);
+        QVector<QRgb> table;
+        table.append(0xFFFFFFFF);
+        table.append(0xFF000000);
+        img.setColorTable(table);
+    } else if ((m_depth == 8) || (QT_VERSION < QT_VERSION_CHECK(5, 13, 0))) {
+        img = QImage(m_width, m_lines, (m_channels == 3) ? QImage::Format_RGB888 : QImage::Format_Grayscale8);
+    }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+    else {
+        img = QImage(m_width, m_lines, (m_channels == 3) ? QImage::Format_RGBX64 : QImage::Format_Grayscale16);
+    }
+#endif
+    if (img.isNull()) {
+        m_failed = true;
+        m_errorString = i18n("The image is empty.");
+        return false;
+    }
+
+    // SANE delivers 16 bit samples in the byte order of the host
+    const bool bigEndian = (Q_BYTE_ORDER == Q_BIG_ENDIAN);
+    for (int l = 0; l < m_lines; ++l) {
+        const uchar *line = src + (qint64)l * m_rowBytes;
+        uchar *dst = img.scanLine(l);
+        if ((m_depth == 1) || (m_depth == 8)) {
+            memcpy(dst, line, m_rowBytes);
+        } else if (img.depth() == 8 || img.depth() == 24) {
+            // no 16 bit formats in this Qt version, keep the high bytes
+            const int msb = (Q_BYTE_ORDER == Q_BIG_ENDIAN) ? 0 : 1;
+            for (int i = 0; i < m_width * m_channels; ++i) {
+                dst[i] = line[i * 2 + msb];
+            }
+        } else if (m_channels == 3) {
+            PixelOps::rgb48ToRgbx64(reinterpret_cast<quint16 *>(dst), line, m_width, bigEndian);
+        } else {
+            PixelOps::samples16ToHost(reinterpret_cast<quint16 *>(dst), line, m_width, bigEndian);
+        }
+    }
+    m_pending.clear();
+
+    int dpm = (int)(m_dpi * (1000.0 / 25.4) + 0.5);
+    if (dpm > 0) {
+        img.setDotsPerMeterX(dpm);
+        img.setDotsPerMeterY(dpm);
+    }
+    QImageWriter writer(m_output, "png");
+    if (!writer.write(img)) {
+        m_failed = true;
+        m_errorString = writer.errorString();
+        return false;
+    }
+    return true;
+}
+
+}  // NameSpace KSaneIface
@@ -0,0 +1,147 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#ifndef KSANE_IMAGE_ENCODER_H
+#define KSANE_IMAGE_ENCODER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QByteArray>
+#include <QVector>
+#include <QPointer>
+#include <QIODevice>
+
+#include "ksanewidget.h"
+
+#define TIFF_STRIP_BYTES (256 * 1024)
+
+namespace KSaneIface
+{
+
+/** Encodes a final scan to BMP, TIFF or PNG while it is scanned.
+ * The scan thread hands over strips of complete interleaved lines with
+ * addStrip() and the encoder writes them from its own thread. Headers that
+ * depend on the number of lines are written at the start and patched when
+ * the image is finished. */
+class KSaneImageEncoder: public QThread
+{
+    Q_OBJECT
+public:
+    KSaneImageEncoder();
+    ~KSaneImageEncoder();
+
+    /** Select the format and the output. An empty file name and no device
+     * keeps the encoded image in memory.
+     * @return false if the format can not be written to the output. */
+    bool setOutput(KSaneWidget::EncodeFormat format, const QString &fileName, QIODevice *device);
+    KSaneWidget::EncodeFormat format() const;
+    /** @return true if the encoded image is kept in memory. */
+    bool toMemory() const;
+    void setResolution(float dpi);
+    /** The next image is the first of a batch. The following images of the
+     * batch are written to files with -2, -3, ... appended to the base name.
+     * A device gets the images of a batch one after the other. */
+    void startBatch();
+
+    /** Start encoding a new image. Called by the scan thread.
+     * @param width is the width in pixels.
+     * @param height is the number of lines or -1 if it is not known.
+     * @param depth is the number of bits per sample (1, 8 or 16).
+     * @param channels is 1 for gray and 3 for RGB.
+     * @param lineBytes is the number of bytes per line in the strips. */
+    void begin(int width, int height, int depth, int channels, int lineBytes);
+    /** Queue complete lines for encoding. */
+    void addStrip(const QByteArray &strip);
+    /** No more lines will come. The image is discarded if @p completed is false. */
+    void finish(bool completed);
+
+    /** The result of the last image. Only valid after the thread has finished. */
+    bool succeeded() const;
+    QString errorString() const;
+    QByteArray encodedData() const;
+
+protected:
+    void run();
+
+private:
+    QString imageFileName() const;
+    bool openOutput();
+    void closeOutput(bool success);
+    bool write(const QByteArray &data);
+    bool writeAt(qint64 pos, const QByteArray &data);
+    bool writeHeader();
+    bool writeLines(const uchar *data, int lines);
+    bool writeTrailer();
+
+    bool writeBmpHeader();
+    bool writeBmpLines(const uchar *data, int lines);
+    bool patchBmpHeader();
+    bool flushTiffStrip();
+    bool writeTiffDirectory();
+    bool writePng();
+
+    KSaneWidget::EncodeFormat m_format;
+    QString             m_fileName;
+    QPointer<QIODevice> m_device;
+    QIODevice          *m_output;     ///< the device written by run()
+    bool                m_ownsOutput;
+    bool                m_createdFile; ///< the output file did not exist before
+    qint64              m_start;      ///< the position of the image in the output
+    int                 m_imageCount; ///< images of the batch so far
+    float               m_dpi;
+
+    // the image being encoded
+    int                 m_width;
+    int                 m_height;
+    int                 m_depth;
+    int                 m_channels;
+    int                 m_lineBytes;  ///< bytes per line in the strips
+    int                 m_rowBytes;   ///< bytes per line without padding
+    int                 m_lines;      ///< lines written so far
+
+    // shared with the scan thread
+    QMutex              m_mutex;
+    QWaitCondition      m_dataAvailable;
+    QQueue<QByteArray>  m_queue;
+    bool                m_finishing;
+    bool                m_completed;
+
+    QByteArray          m_encoded;    ///< the image if it is kept in memory
+    QByteArray          m_pending;    ///< TIFF lines of the next strip, PNG lines of the image
+    QVector<quint32>    m_stripOffsets;
+    QVector<quint32>    m_stripBytes;
+    int                 m_rowsPerStrip;
+    bool                m_failed;
+    QString             m_errorString;
+};
+
+}
+
+#endif
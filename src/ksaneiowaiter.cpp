@@ -0,0 +1,149 @@
+/* ============================================================
+*
+* This file is part of the KDE project
+*
+* Date        : 2026-10-17
+* Description : Sane interface for KDE
+*
+* Copyright (C) 2026 by the KSane developers
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) version 3, or any
+* later version accepted by the membership of KDE e.V. (or its
+* successor approved by the membership of KDE e.V.), which shall
+* act as a proxy defined in Section 6 of version 3 of the license.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+* ============================================================ */
+
+#include "ksaneiowaiter.h"
+
+#include <QtGlobal>
+#include <QDebug>
+
+#ifdef Q_OS_UNIX
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// check the backend even if the select fd stays quiet
+#define WAIT_TIMEOUT_MSEC 100
+
+namespace KSaneIface
+{
+
+KSaneIoWaiter::KSaneIoWaiter():
+    m_selectFd(-1),
+    m_nonBlocking(false)
+{
+    m_wakeFds[0] = -1;
+    m_wakeFds[1] = -1;
+#ifdef Q_OS_UNIX
+    if (pipe(m_wakeFds) == 0) {
+        fcntl(m_wakeFds[0], F_SETFL, O_NONBLOCK);
+        fcntl(m_wakeFds[1], F_SETFL, O_NONBLOCK);
+        fcntl(m_wakeFds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(m_wakeFds[1], F_SETFD, FD_CLOEXEC);
+    } else {
+        qDebug() << "Could not create the cancel pipe, using blocking reads";
+        m_wakeFds[0] = -1;
+        m_wakeFds[1] = -1;
+    }
+#endif
+}
+
+KSaneIoWaiter::~KSaneIoWaiter()
+{
+#ifdef Q_OS_UNIX
+    if (m_wakeFds[0] != -1) {
+        close(m_wakeFds[0]);
+        close(m_wakeFds[1]);
+    }
+#endif
+}
+
+bool KSaneIoWaiter::setNonBlocking(SANE_Handle handle)
+{
+    m_nonBlocking = false;
+    m_selectFd = -1;
+#ifdef Q_OS_UNIX
+    if (m_wakeFds[0] == -1) {
+        return false;
+    }
+    if (sane_set_io_mode(handle, SANE_TRUE) != SANE_STATUS_GOOD) {
+        return false;
+    }
+    SANE_Int fd;
+    if (sane_get_select_fd(handle, &fd) != SANE_STATUS_GOOD) {
+        // non-blocking reads without a fd to wait on would just spin
+        sane_set_io_mode(handle, SANE_FALSE);
+        return false;
+    }
+    m_selectFd = fd;
+    m_nonBlocking = true;
+#else
+    Q_UNUSED(handle);
+#endif
+    return m_nonBlocking;
+}
+
+bool KSaneIoWaiter::isNonBlocking() const
+{
+    return m_nonBlocking;
+}
+
+bool KSaneIoWaiter::waitForData()
+{
+#ifdef Q_OS_UNIX
+    struct pollfd fds[2];
+    fds[0].fd      = m_selectFd;
+    fds[0].events  = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd      = m_wakeFds[0];
+    fds[1].events  = POLLIN;
+    fds[1].revents = 0;
+
+    if (poll(fds, 2, WAIT_TIMEOUT_MSEC) > 0) {
+        if (fds[1].revents & POLLIN) {
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+void KSaneIoWaiter::cancel()
+{
+#ifdef Q_OS_UNIX
+    if (m_wakeFds[1] != -1) {
+        char c = 0;
+        // a full pipe is fine, the reader is woken up anyway
+        if (write(m_wakeFds[1], &c, 1) < 0) {
+            return;
+        }
+    }
+#endif
+}
+
+void KSaneIoWaiter::reset()
+{
+#ifdef Q_OS_UNIX
+    if (m_wakeFds[0] != -1) {
+        char buf[64];
+        while (read(m_wakeFds[0], buf, sizeof(buf)) > 0) {
+        }
+    }
+#endif
+}
+
+}  // NameSpace KSaneIface
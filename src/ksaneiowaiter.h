@@ -0,0 +1,75 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+#ifndef KSANE_IO_WAITER_H
+#define KSANE_IO_WAITER_H
+
+// Sane includes
+extern "C"
+{
+#include <sane/saneopts.h>
+#include <sane/sane.h>
+}
+
+namespace KSaneIface
+{
+
+/** Lets a reader thread sleep on the select fd of a non-blocking backend
+ * instead of inside sane_read(). cancel() wakes the reader up immediately,
+ * so a scan can be canceled without waiting for the backend. Backends
+ * without non-blocking support keep the blocking sane_read(). */
+class KSaneIoWaiter
+{
+public:
+    KSaneIoWaiter();
+    ~KSaneIoWaiter();
+
+    /** Switch @p handle to non-blocking mode if the backend supports it.
+     * This must be done after every sane_start().
+     * @return true if the reads are non-blocking. */
+    bool setNonBlocking(SANE_Handle handle);
+    bool isNonBlocking() const;
+
+    /** Wait until the backend has data, cancel() is called or a timeout.
+     * @return false if the wait was canceled. */
+    bool waitForData();
+
+    /** Wake up waitForData(). This can be called from any thread. */
+    void cancel();
+
+    /** Forget an earlier cancel() before a new scan is started. */
+    void reset();
+
+private:
+    int  m_selectFd;
+    int  m_wakeFds[2];
+    bool m_nonBlocking;
+};
+
+}
+
+#endif
@@ -0,0 +1,812 @@
+/* ============================================================
+*
+* This file is part of the KDE project
+*
+* Date        : 2026-10-17
+* Description : Sane interface for KDE
+*
+* Copyright (C) 2026 by the KSane developers
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) version 3, or any
+* later version accepted by the membership of KDE e.V. (or its
+* successor approved by the membership of KDE e.V.), which shall
+* act as a proxy defined in Section 6 of version 3 of the license.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+* ============================================================ */
+
+#include "ksanepixelops.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KSANE_X86_SIMD
+#include <immintrin.h>
+#define KSANE_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// the NEON kernels store the bytes of a QRgb in little endian order
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && (Q_BYTE_ORDER == Q_LITTLE_ENDIAN)
+#define KSANE_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
+namespace KSaneIface
+{
+namespace PixelOps
+{
+
+// ------------------------------------------------------------------------
+// Scalar versions. These are the reference for the vectorized ones.
+static void invertScalar(uchar *data, int size)
+{
+    for (int i = 0; i < size; i++) {
+        data[i] = ~data[i];
+    }
+}
+
+// rgb points to a whole pixel, samples has sampleBytes bytes per sample
+static void mergeSamplesScalar(uchar *rgb, const uchar *plane, int samples, int sampleBytes, int channel)
+{
+    uchar *dst = rgb + channel * sampleBytes;
+    const int pixelBytes = 3 * sampleBytes;
+    if (sampleBytes == 1) {
+        for (int i = 0; i < samples; i++) {
+            *dst = plane[i];
+            dst += pixelBytes;
+        }
+    } else {
+        for (int i = 0; i < samples; i++) {
+            dst[0] = plane[0];
+            dst[1] = plane[1];
+            plane += 2;
+            dst += pixelBytes;
+        }
+    }
+}
+
+#define OPAQUE 0xFF000000u
+
+static void grayToRgb32Scalar(quint32 *dst, const uchar *src, int pixels, int sampleBytes)
+{
+    // 16 bit samples are shown with the byte at offset 1
+    src += sampleBytes - 1;
+    for (int i = 0; i < pixels; i++) {
+        dst[i] = OPAQUE | (*src * 0x010101u);
+        src += sampleBytes;
+    }
+}
+
+static void rgbToRgb32Scalar(quint32 *dst, const uchar *src, int pixels, int sampleBytes)
+{
+    src += sampleBytes - 1;
+    for (int i = 0; i < pixels; i++) {
+        dst[i] = OPAQUE | (src[0] << 16) | (src[sampleBytes] << 8) | src[2 * sampleBytes];
+        src += 3 * sampleBytes;
+    }
+}
+
+static void swap16Scalar(quint16 *dst, const uchar *src, int samples)
+{
+    quint16 sample;
+    for (int i = 0; i < samples; i++) {
+        memcpy(&sample, src + 2 * i, sizeof(sample));
+        dst[i] = (quint16)((sample << 8) | (sample >> 8));
+    }
+}
+
+// The samples are copied as they are, or with the two bytes swapped
+static void rgb48ToRgbx64Scalar(quint16 *dst, const uchar *src, int pixels, bool swap)
+{
+    for (int i = 0; i < pixels; i++) {
+        memcpy(dst, src, 6);
+        if (swap) {
+            for (int c = 0; c < 3; c++) {
+                dst[c] = (quint16)((dst[c] << 8) | (dst[c] >> 8));
+            }
+        }
+        dst[3] = 0xFFFF;
+        dst += 4;
+        src += 6;
+    }
+}
+
+// The same weights as qGray()
+static void rgb32ToGrayScalar(uchar *dst, const quint32 *src, int pixels)
+{
+    for (int i = 0; i < pixels; i++) {
+        quint32 p = src[i];
+        dst[i] = (uchar)((((p >> 16) & 0xFF) * 11 + ((p >> 8) & 0xFF) * 16 + (p & 0xFF) * 5) / 32);
+    }
+}
+
+// The pixels from @p first up to @p last of the inside of a line
+static void edgeRangeScalar(quint16 *dst, const uchar *above, const uchar *line, const uchar *below,
+                            int first, int last, int trigger)
+{
+    for (int i = first; i < last; i++) {
+        int pix = line[i];
+        int diff = qAbs(pix - line[i - 1]) + qAbs(pix - line[i + 1]) + qAbs(pix - above[i]) + qAbs(pix - below[i]);
+        dst[i] = (quint16)((diff > trigger) ? diff : 0);
+    }
+}
+
+static void edgeStrengthScalar(quint16 *dst, const uchar *above, const uchar *line, const uchar *below,
+                               int pixels, int trigger)
+{
+    edgeRangeScalar(dst, above, line, below, 1, pixels - 1, trigger);
+}
+
+static qint64 addColumnSumsScalar(qint64 *sums, const quint16 *values, int pixels)
+{
+    qint64 total = 0;
+    for (int i = 0; i < pixels; i++) {
+        sums[i] += values[i];
+        total += values[i];
+    }
+    return total;
+}
+
+// ------------------------------------------------------------------------
+// One line-art byte expands to eight pixels
+struct MonoTable {
+    quint32 pixels[256 * 8];
+    MonoTable()
+    {
+        for (int b = 0; b < 256; b++) {
+            for (int j = 0; j < 8; j++) {
+                pixels[b * 8 + j] = (b & (0x80 >> j)) ? OPAQUE : 0xFFFFFFFFu;
+            }
+        }
+    }
+};
+
+static const quint32 *monoTable()
+{
+    static const MonoTable s_table;
+    return s_table.pixels;
+}
+
+#ifdef KSANE_X86_SIMD
+// ------------------------------------------------------------------------
+KSANE_TARGET("sse2") static void grayToRgb32Sse2(quint32 *dst, const uchar *src, int pixels, int sampleBytes)
+{
+    const __m128i alpha = _mm_set1_epi32((int)OPAQUE);
+    int i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        __m128i g;
+        if (sampleBytes == 1) {
+            g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        } else {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * i));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * i + 16));
+            g = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+        }
+        __m128i gg0 = _mm_unpacklo_epi8(g, g);
+        __m128i gg1 = _mm_unpackhi_epi8(g, g);
+        __m128i *d = reinterpret_cast<__m128i *>(dst + i);
+        _mm_storeu_si128(d,     _mm_or_si128(_mm_unpacklo_epi16(gg0, gg0), alpha));
+        _mm_storeu_si128(d + 1, _mm_or_si128(_mm_unpackhi_epi16(gg0, gg0), alpha));
+        _mm_storeu_si128(d + 2, _mm_or_si128(_mm_unpacklo_epi16(gg1, gg1), alpha));
+        _mm_storeu_si128(d + 3, _mm_or_si128(_mm_unpackhi_epi16(gg1, gg1), alpha));
+    }
+    grayToRgb32Scalar(dst + i, src + i * sampleBytes, pixels - i, sampleBytes);
+}
+
+// ------------------------------------------------------------------------
+KSANE_TARGET("sse2") static inline __m128i grayOf4(__m128i px)
+{
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    // the products fit in the low 16 bits of each 32 bit lane
+    __m128i sum = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(px, 16), mask), _mm_set1_epi32(11));
+    sum = _mm_add_epi32(sum, _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(px, 8), mask), 4));
+    sum = _mm_add_epi32(sum, _mm_mullo_epi16(_mm_and_si128(px, mask), _mm_set1_epi32(5)));
+    return _mm_srli_epi32(sum, 5);
+}
+
+KSANE_TARGET("sse2") static void rgb32ToGraySse2(uchar *dst, const quint32 *src, int pixels)
+{
+    int i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        const __m128i *s = reinterpret_cast<const __m128i *>(src + i);
+        __m128i g0 = _mm_packs_epi32(grayOf4(_mm_loadu_si128(s)), grayOf4(_mm_loadu_si128(s + 1)));
+        __m128i g1 = _mm_packs_epi32(grayOf4(_mm_loadu_si128(s + 2)), grayOf4(_mm_loadu_si128(s + 3)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(g0, g1));
+    }
+    rgb32ToGrayScalar(dst + i, src + i, pixels - i);
+}
+
+KSANE_TARGET("sse2") static inline __m128i absDiffU8(__m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+}
+
+KSANE_TARGET("sse2") static void edgeStrengthSse2(quint16 *dst, const uchar *above, const uchar *line,
+                                                  const uchar *below, int pixels, int trigger)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i trig = _mm_set1_epi16((short)qMin(trigger, 0x7FFF));
+    int i = 1;
+    // line[i + 16] is the right neighbour of the last pixel
+    for (; i + 16 < pixels; i += 16) {
+        __m128i pix = _mm_loadu_si128(reinterpret_cast<const __m128i *>(line + i));
+        __m128i d[4];
+        d[0] = absDiffU8(pix, _mm_loadu_si128(reinterpret_cast<const __m128i *>(line + i - 1)));
+        d[1] = absDiffU8(pix, _mm_loadu_si128(reinterpret_cast<const __m128i *>(line + i + 1)));
+        d[2] = absDiffU8(pix, _mm_loadu_si128(reinterpret_cast<const __m128i *>(above + i)));
+        d[3] = absDiffU8(pix, _mm_loadu_si128(reinterpret_cast<const __m128i *>(below + i)));
+        __m128i lo = zero;
+        __m128i hi = zero;
+        for (int n = 0; n < 4; n++) {
+            lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(d[n], zero));
+            hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(d[n], zero));
+        }
+        lo = _mm_and_si128(lo, _mm_cmpgt_epi16(lo, trig));
+        hi = _mm_and_si128(hi, _mm_cmpgt_epi16(hi, trig));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 8), hi);
+    }
+    edgeRangeScalar(dst, above, line, below, i, pixels - 1, trigger);
+}
+
+KSANE_TARGET("sse2") static qint64 addColumnSumsSse2(qint64 *sums, const quint16 *values, int pixels)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i total = zero;
+    int i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+        __m128i v32[2] = { _mm_unpacklo_epi16(v, zero), _mm_unpackhi_epi16(v, zero) };
+        __m128i *s = reinterpret_cast<__m128i *>(sums + i);
+        for (int n = 0; n < 2; n++) {
+            __m128i v0 = _mm_unpacklo_epi32(v32[n], zero);
+            __m128i v1 = _mm_unpackhi_epi32(v32[n], zero);
+            _mm_storeu_si128(s + 2 * n,     _mm_add_epi64(_mm_loadu_si128(s + 2 * n), v0));
+            _mm_storeu_si128(s + 2 * n + 1, _mm_add_epi64(_mm_loadu_si128(s + 2 * n + 1), v1));
+            total = _mm_add_epi64(total, _mm_add_epi64(v0, v1));
+        }
+    }
+    qint64 lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), total);
+    return lanes[0] + lanes[1] + addColumnSumsScalar(sums + i, values + i, pixels - i);
+}
+
+// ------------------------------------------------------------------------
+// Four pixels of 3 bytes (R, G, B) become four pixels of 4 bytes (B, G, R, A)
+KSANE_TARGET("ssse3") static inline __m128i rgb4ToRgb32(__m128i rgb, __m128i shuffle, __m128i alpha)
+{
+    return _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha);
+}
+
+KSANE_TARGET("ssse3") static void rgbToRgb32Ssse3(quint32 *dst, const uchar *src, int pixels, int sampleBytes)
+{
+    const __m128i alpha   = _mm_set1_epi32((int)OPAQUE);
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128);
+    // picks the most significant bytes of eight 16 bit samples
+    const __m128i msb     = _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, -128, -128, -128, -128, -128, -128, -128, -128);
+    int i = 0;
+    if (sampleBytes == 1) {
+        for (; i + 16 <= pixels; i += 16) {
+            const __m128i *s = reinterpret_cast<const __m128i *>(src + i * 3);
+            __m128i v0 = _mm_loadu_si128(s);
+            __m128i v1 = _mm_loadu_si128(s + 1);
+            __m128i v2 = _mm_loadu_si128(s + 2);
+            __m128i *d = reinterpret_cast<__m128i *>(dst + i);
+            _mm_storeu_si128(d,     rgb4ToRgb32(v0, shuffle, alpha));
+            _mm_storeu_si128(d + 1, rgb4ToRgb32(_mm_alignr_epi8(v1, v0, 12), shuffle, alpha));
+            _mm_storeu_si128(d + 2, rgb4ToRgb32(_mm_alignr_epi8(v2, v1, 8), shuffle, alpha));
+            _mm_storeu_si128(d + 3, rgb4ToRgb32(_mm_srli_si128(v2, 4), shuffle, alpha));
+        }
+    } else {
+        for (; i + 8 <= pixels; i += 8) {
+            const __m128i *s = reinterpret_cast<const __m128i *>(src + i * 6);
+            __m128i s0 = _mm_shuffle_epi8(_mm_loadu_si128(s), msb);
+            __m128i s1 = _mm_shuffle_epi8(_mm_loadu_si128(s + 1), msb);
+            __m128i s2 = _mm_shuffle_epi8(_mm_loadu_si128(s + 2), msb);
+            __m128i v0 = _mm_unpacklo_epi64(s0, s1);
+            __m128i *d = reinterpret_cast<__m128i *>(dst + i);
+            _mm_storeu_si128(d,     rgb4ToRgb32(v0, shuffle, alpha));
+            _mm_storeu_si128(d + 1, rgb4ToRgb32(_mm_alignr_epi8(s2, v0, 12), shuffle, alpha));
+        }
+    }
+    rgbToRgb32Scalar(dst + i, src + i * 3 * sampleBytes, pixels - i, sampleBytes);
+}
+
+// ------------------------------------------------------------------------
+KSANE_TARGET("ssse3") static void rgb48ToRgbx64Ssse3(quint16 *dst, const uchar *src, int pixels, bool swap)
+{
+    // two pixels of 6 bytes become two pixels of 8 bytes
+    const __m128i shuffle = swap ?
+                            _mm_setr_epi8(1, 0, 3, 2, 5, 4, -128, -128, 7, 6, 9, 8, 11, 10, -128, -128) :
+                            _mm_setr_epi8(0, 1, 2, 3, 4, 5, -128, -128, 6, 7, 8, 9, 10, 11, -128, -128);
+    const __m128i alpha = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+    int i = 0;
+    // the second load reads 4 bytes past the 4 pixels
+    for (; i + 5 <= pixels; i += 4) {
+        __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 6));
+        __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 6 + 12));
+        __m128i *d = reinterpret_cast<__m128i *>(dst + i * 4);
+        _mm_storeu_si128(d,     _mm_or_si128(_mm_shuffle_epi8(v0, shuffle), alpha));
+        _mm_storeu_si128(d + 1, _mm_or_si128(_mm_shuffle_epi8(v1, shuffle), alpha));
+    }
+    rgb48ToRgbx64Scalar(dst + i * 4, src + i * 6, pixels - i, swap);
+}
+
+// ------------------------------------------------------------------------
+KSANE_TARGET("sse2") static void swap16Sse2(quint16 *dst, const uchar *src, int samples)
+{
+    int i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                         _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+    swap16Scalar(dst + i, src + i * 2, samples - i);
+}
+
+// ------------------------------------------------------------------------
+KSANE_TARGET("sse2") static void invertSse2(uchar *data, int size)
+{
+    const __m128i ones = _mm_set1_epi8(-1);
+    int i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), _mm_xor_si128(v, ones));
+    }
+    invertScalar(data + i, size - i);
+}
+
+// ------------------------------------------------------------------------
+KSANE_TARGET("avx2") static void invertAvx2(uchar *data, int size)
+{
+    const __m256i ones = _mm256_set1_epi8(-1);
+    int i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(data + i), _mm256_xor_si256(v, ones));
+    }
+    invertScalar(data + i, size - i);
+}
+
+// ------------------------------------------------------------------------
+// One iteration scatters 16 source bytes into 48 bytes of interleaved data.
+// Byte j of the destination gets a source byte if it belongs to the channel.
+static void mergeTables(int sampleBytes, int channel, uchar shuffle[3][16], uchar blend[3][16])
+{
+    const int pixelBytes = 3 * sampleBytes;
+    for (int j = 0; j < 48; j++) {
+        int within = j % pixelBytes;
+        if (within / sampleBytes == channel) {
+            shuffle[j / 16][j % 16] = (j / pixelBytes) * sampleBytes + within % sampleBytes;
+            blend[j / 16][j % 16]   = 0xFF;
+        } else {
+            shuffle[j / 16][j % 16] = 0x80; // pshufb writes a zero
+            blend[j / 16][j % 16]   = 0x00;
+        }
+    }
+}
+
+KSANE_TARGET("ssse3") static void mergeSamplesSsse3(uchar *rgb, const uchar *plane, int samples, int sampleBytes, int channel)
+{
+    uchar shuffleBytes[3][16];
+    uchar blendBytes[3][16];
+    mergeTables(sampleBytes, channel, shuffleBytes, blendBytes);
+
+    __m128i shuffle[3];
+    __m128i blend[3];
+    for (int v = 0; v < 3; v++) {
+        shuffle[v] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(shuffleBytes[v]));
+        blend[v]   = _mm_loadu_si128(reinterpret_cast<const __m128i *>(blendBytes[v]));
+    }
+
+    const int step = 16 / sampleBytes;
+    int i = 0;
+    for (; i + step <= samples; i += step) {
+        __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(plane + i * sampleBytes));
+        __m128i *dst = reinterpret_cast<__m128i *>(rgb + i * 3 * sampleBytes);
+        for (int v = 0; v < 3; v++) {
+            __m128i old = _mm_loadu_si128(dst + v);
+            __m128i val = _mm_shuffle_epi8(src, shuffle[v]);
+            _mm_storeu_si128(dst + v, _mm_or_si128(_mm_andnot_si128(blend[v], old), val));
+        }
+    }
+    mergeSamplesScalar(rgb + i * 3 * sampleBytes, plane + i * sampleBytes, samples - i, sampleBytes, channel);
+}
+#endif
+
+#ifdef KSANE_NEON_SIMD
+// ------------------------------------------------------------------------
+static void mergeSamplesNeon(uchar *rgb, const uchar *plane, int samples, int sampleBytes, int channel)
+{
+    int i = 0;
+    if (sampleBytes == 1) {
+        for (; i + 16 <= samples; i += 16) {
+            uint8x16x3_t px = vld3q_u8(rgb + i * 3);
+            px.val[channel] = vld1q_u8(plane + i);
+            vst3q_u8(rgb + i * 3, px);
+        }
+    } else {
+        for (; i + 8 <= samples; i += 8) {
+            // the samples are only moved, so the byte order does not matter
+            uint16_t *dst = reinterpret_cast<uint16_t *>(rgb + i * 6);
+            uint16x8x3_t px = vld3q_u16(dst);
+            px.val[channel] = vreinterpretq_u16_u8(vld1q_u8(plane + i * 2));
+            vst3q_u16(dst, px);
+        }
+    }
+    mergeSamplesScalar(rgb + i * 3 * sampleBytes, plane + i * sampleBytes, samples - i, sampleBytes, channel);
+}
+
+// ------------------------------------------------------------------------
+static void grayToRgb32Neon(quint32 *dst, const uchar *src, int pixels, int sampleBytes)
+{
+    int i = 0;
+    uint8x16x4_t px;
+    px.val[3] = vdupq_n_u8(0xFF);
+    for (; i + 16 <= pixels; i += 16) {
+        uint8x16_t g = (sampleBytes == 1) ? vld1q_u8(src + i) : vld2q_u8(src + 2 * i).val[1];
+        px.val[0] = g;
+        px.val[1] = g;
+        px.val[2] = g;
+        vst4q_u8(reinterpret_cast<uint8_t *>(dst + i), px);
+    }
+    grayToRgb32Scalar(dst + i, src + i * sampleBytes, pixels - i, sampleBytes);
+}
+
+static void rgbToRgb32Neon(quint32 *dst, const uchar *src, int pixels, int sampleBytes)
+{
+    int i = 0;
+    if (sampleBytes == 1) {
+        uint8x16x4_t px;
+        px.val[3] = vdupq_n_u8(0xFF);
+        for (; i + 16 <= pixels; i += 16) {
+            uint8x16x3_t rgb = vld3q_u8(src + i * 3);
+            px.val[0] = rgb.val[2];
+            px.val[1] = rgb.val[1];
+            px.val[2] = rgb.val[0];
+            vst4q_u8(reinterpret_cast<uint8_t *>(dst + i), px);
+        }
+    } else {
+        uint8x8x4_t px;
+        px.val[3] = vdup_n_u8(0xFF);
+        for (; i + 8 <= pixels; i += 8) {
+            uint16x8x3_t rgb = vld3q_u16(reinterpret_cast<const uint16_t *>(src + i * 6));
+            px.val[0] = vshrn_n_u16(rgb.val[2], 8);
+            px.val[1] = vshrn_n_u16(rgb.val[1], 8);
+            px.val[2] = vshrn_n_u16(rgb.val[0], 8);
+            vst4_u8(reinterpret_cast<uint8_t *>(dst + i), px);
+        }
+    }
+    rgbToRgb32Scalar(dst + i, src + i * 3 * sampleBytes, pixels - i, sampleBytes);
+}
+
+// ------------------------------------------------------------------------
+static void swap16Neon(quint16 *dst, const uchar *src, int samples)
+{
+    int i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        vst1q_u8(reinterpret_cast<uint8_t *>(dst + i), vrev16q_u8(vld1q_u8(src + i * 2)));
+    }
+    swap16Scalar(dst + i, src + i * 2, samples - i);
+}
+
+static void rgb48ToRgbx64Neon(quint16 *dst, const uchar *src, int pixels, bool swap)
+{
+    int i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        uint16x8x3_t rgb = vld3q_u16(reinterpret_cast<const uint16_t *>(src + i * 6));
+        uint16x8x4_t rgbx;
+        for (int c = 0; c < 3; c++) {
+            rgbx.val[c] = swap ? vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(rgb.val[c]))) : rgb.val[c];
+        }
+        rgbx.val[3] = vdupq_n_u16(0xFFFF);
+        vst4q_u16(reinterpret_cast<uint16_t *>(dst + i * 4), rgbx);
+    }
+    rgb48ToRgbx64Scalar(dst + i * 4, src + i * 6, pixels - i, swap);
+}
+
+// ------------------------------------------------------------------------
+static void rgb32ToGrayNeon(uchar *dst, const quint32 *src, int pixels)
+{
+    int i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        // B, G, R, A in memory
+        uint8x16x4_t px = vld4q_u8(reinterpret_cast<const uint8_t *>(src + i));
+        uint16x8_t lo = vmull_u8(vget_low_u8(px.val[2]), vdup_n_u8(11));
+        lo = vmlal_u8(lo, vget_low_u8(px.val[1]), vdup_n_u8(16));
+        lo = vmlal_u8(lo, vget_low_u8(px.val[0]), vdup_n_u8(5));
+        uint16x8_t hi = vmull_u8(vget_high_u8(px.val[2]), vdup_n_u8(11));
+        hi = vmlal_u8(hi, vget_high_u8(px.val[1]), vdup_n_u8(16));
+        hi = vmlal_u8(hi, vget_high_u8(px.val[0]), vdup_n_u8(5));
+        vst1q_u8(dst + i, vcombine_u8(vshrn_n_u16(lo, 5), vshrn_n_u16(hi, 5)));
+    }
+    rgb32ToGrayScalar(dst + i, src + i, pixels - i);
+}
+
+static void edgeStrengthNeon(quint16 *dst, const uchar *above, const uchar *line, const uchar *below,
+                             int pixels, int trigger)
+{
+    const uint16x8_t trig = vdupq_n_u16((quint16)qMin(trigger, 0xFFFF));
+    int i = 1;
+    // line[i + 16] is the right neighbour of the last pixel
+    for (; i + 16 < pixels; i += 16) {
+        uint8x16_t pix = vld1q_u8(line + i);
+        uint8x16_t left = vld1q_u8(line + i - 1);
+        uint8x16_t right = vld1q_u8(line + i + 1);
+        uint8x16_t up = vld1q_u8(above + i);
+        uint8x16_t down = vld1q_u8(below + i);
+        uint16x8_t lo = vabdl_u8(vget_low_u8(pix), vget_low_u8(left));
+        lo = vabal_u8(lo, vget_low_u8(pix), vget_low_u8(right));
+        lo = vabal_u8(lo, vget_low_u8(pix), vget_low_u8(up));
+        lo = vabal_u8(lo, vget_low_u8(pix), vget_low_u8(down));
+        uint16x8_t hi = vabdl_u8(vget_high_u8(pix), vget_high_u8(left));
+        hi = vabal_u8(hi, vget_high_u8(pix), vget_high_u8(right));
+        hi = vabal_u8(hi, vget_high_u8(pix), vget_high_u8(up));
+        hi = vabal_u8(hi, vget_high_u8(pix), vget_high_u8(down));
+        vst1q_u16(dst + i, vandq_u16(lo, vcgtq_u16(lo, trig)));
+        vst1q_u16(dst + i + 8, vandq_u16(hi, vcgtq_u16(hi, trig)));
+    }
+    edgeRangeScalar(dst, above, line, below, i, pixels - 1, trigger);
+}
+
+static qint64 addColumnSumsNeon(qint64 *sums, const quint16 *values, int pixels)
+{
+    uint64x2_t total = vdupq_n_u64(0);
+    int i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        uint32x4_t v = vmovl_u16(vld1_u16(values + i));
+        uint64x2_t v0 = vmovl_u32(vget_low_u32(v));
+        uint64x2_t v1 = vmovl_u32(vget_high_u32(v));
+        vst1q_s64(sums + i,     vaddq_s64(vld1q_s64(sums + i),     vreinterpretq_s64_u64(v0)));
+        vst1q_s64(sums + i + 2, vaddq_s64(vld1q_s64(sums + i + 2), vreinterpretq_s64_u64(v1)));
+        total = vaddq_u64(total, vaddq_u64(v0, v1));
+    }
+    return (qint64)(vgetq_lane_u64(total, 0) + vgetq_lane_u64(total, 1)) +
+           addColumnSumsScalar(sums + i, values + i, pixels - i);
+}
+
+static void invertNeon(uchar *data, int size)
+{
+    int i = 0;
+    for (; i + 16 <= size; i += 16) {
+        vst1q_u8(data + i, vmvnq_u8(vld1q_u8(data + i)));
+    }
+    invertScalar(data + i, size - i);
+}
+#endif
+
+// ------------------------------------------------------------------------
+struct Kernels {
+    const char *name;
+    void (*invert)(uchar *data, int size);
+    void (*mergeSamples)(uchar *rgb, const uchar *plane, int samples, int sampleBytes, int channel);
+    void (*grayToRgb32)(quint32 *dst, const uchar *src, int pixels, int sampleBytes);
+    void (*rgbToRgb32)(quint32 *dst, const uchar *src, int pixels, int sampleBytes);
+    void (*swap16)(quint16 *dst, const uchar *src, int samples);
+    void (*rgb48ToRgbx64)(quint16 *dst, const uchar *src, int pixels, bool swap);
+    void (*rgb32ToGray)(uchar *dst, const quint32 *src, int pixels);
+    void (*edgeStrength)(quint16 *dst, const uchar *above, const uchar *line, const uchar *below,
+                         int pixels, int trigger);
+    qint64 (*addColumnSums)(qint64 *sums, const quint16 *values, int pixels);
+};
+
+// The instruction sets in the order they are tried
+static const char *const s_instructionSets[] = { "scalar", "sse2", "ssse3", "avx2", "neon" };
+static const int s_instructionSetCount = sizeof(s_instructionSets) / sizeof(s_instructionSets[0]);
+
+/** Select the best kernels of the running CPU, but none of the instruction
+ * sets after s_instructionSets[maxLevel]. */
+static Kernels selectKernels(int maxLevel)
+{
+    Kernels k;
+    k.name   = "scalar";
+    k.invert = invertScalar;
+    k.mergeSamples = mergeSamplesScalar;
+    k.grayToRgb32  = grayToRgb32Scalar;
+    k.rgbToRgb32   = rgbToRgb32Scalar;
+    k.swap16       = swap16Scalar;
+    k.rgb48ToRgbx64 = rgb48ToRgbx64Scalar;
+    k.rgb32ToGray   = rgb32ToGrayScalar;
+    k.edgeStrength  = edgeStrengthScalar;
+    k.addColumnSums = addColumnSumsScalar;
+
+#ifdef KSANE_X86_SIMD
+    __builtin_cpu_init();
+    if ((maxLevel >= 1) && __builtin_cpu_supports("sse2")) {
+        k.name   = "sse2";
+        k.invert = invertSse2;
+        k.grayToRgb32 = grayToRgb32Sse2;
+        k.swap16      = swap16Sse2;
+        k.rgb32ToGray   = rgb32ToGraySse2;
+        k.edgeStrength  = edgeStrengthSse2;
+        k.addColumnSums = addColumnSumsSse2;
+    }
+    if ((maxLevel >= 2) && __builtin_cpu_supports("ssse3")) {
+        k.name   = "ssse3";
+        k.mergeSamples = mergeSamplesSsse3;
+        k.rgbToRgb32   = rgbToRgb32Ssse3;
+        k.rgb48ToRgbx64 = rgb48ToRgbx64Ssse3;
+    }
+    if ((maxLevel >= 3) && __builtin_cpu_supports("avx2")) {
+        k.name   = "avx2";
+        k.invert = invertAvx2;
+    }
+#endif
+
+#ifdef KSANE_NEON_SIMD
+    if (maxLevel >= 4) {
+        k.name   = "neon";
+        k.invert = invertNeon;
+        k.mergeSamples = mergeSamplesNeon;
+        k.grayToRgb32  = grayToRgb32Neon;
+        k.rgbToRgb32   = rgbToRgb32Neon;
+        k.swap16       = swap16Neon;
+        k.rgb48ToRgbx64 = rgb48ToRgbx64Neon;
+        k.rgb32ToGray   = rgb32ToGrayNeon;
+        k.edgeStrength  = edgeStrengthNeon;
+        k.addColumnSums = addColumnSumsNeon;
+    }
+#else
+    Q_UNUSED(maxLevel);
+#endif
+
+    return k;
+}
+
+static Kernels &kernels()
+{
+    static Kernels s_kernels = selectKernels(s_instructionSetCount - 1);
+    return s_kernels;
+}
+
+// ------------------------------------------------------------------------
+void invert(uchar *data, int size)
+{
+    kernels().invert(data, size);
+}
+
+void mergePlane(uchar *rgb, const uchar *plane, qint64 frameOffset, int size, int depth, int channel)
+{
+    if (size <= 0) {
+        return;
+    }
+    if (depth == 8) {
+        kernels().mergeSamples(rgb + frameOffset * 3, plane, size, 1, channel);
+        return;
+    }
+
+    // 16 bit: a read may start or end in the middle of a sample
+    if (frameOffset % 2) {
+        rgb[(frameOffset / 2) * 6 + 1 + 2 * channel] = plane[0];
+        plane++;
+        frameOffset++;
+        size--;
+    }
+    kernels().mergeSamples(rgb + (frameOffset / 2) * 6, plane, size / 2, 2, channel);
+    if (size % 2) {
+        rgb[((frameOffset + size - 1) / 2) * 6 + 2 * channel] = plane[size - 1];
+    }
+}
+
+void monoToRgb32(quint32 *dst, const uchar *src, int pixels)
+{
+    const quint32 *table = monoTable();
+    int i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        memcpy(dst + i, table + src[i / 8] * 8, 8 * sizeof(quint32));
+    }
+    if (i < pixels) {
+        memcpy(dst + i, table + src[i / 8] * 8, (pixels - i) * sizeof(quint32));
+    }
+}
+
+void grayToRgb32(quint32 *dst, const uchar *src, int pixels, int depth)
+{
+    kernels().grayToRgb32(dst, src, pixels, depth / 8);
+}
+
+void rgbToRgb32(quint32 *dst, const uchar *src, int pixels, int depth)
+{
+    kernels().rgbToRgb32(dst, src, pixels, depth / 8);
+}
+
+void planeToRgb32(quint32 *dst, const uchar *src, int pixels, int depth, int channel)
+{
+    const int sampleBytes = depth / 8;
+    const int shift = 16 - 8 * channel;
+    const quint32 keep = ~(0xFFu << shift);
+    src += sampleBytes - 1;
+    for (int i = 0; i < pixels; i++) {
+        dst[i] = (dst[i] & keep) | ((quint32)src[i * sampleBytes] << shift);
+    }
+}
+
+void samples16ToHost(quint16 *dst, const uchar *src, int samples, bool bigEndian)
+{
+    if (bigEndian == (Q_BYTE_ORDER == Q_BIG_ENDIAN)) {
+        memcpy(dst, src, (size_t)samples * 2);
+    } else {
+        kernels().swap16(dst, src, samples);
+    }
+}
+
+void rgb48ToRgbx64(quint16 *dst, const uchar *src, int pixels, bool bigEndian)
+{
+    kernels().rgb48ToRgbx64(dst, src, pixels, bigEndian != (Q_BYTE_ORDER == Q_BIG_ENDIAN));
+}
+
+static inline quint32 average4(quint32 a, quint32 b, quint32 c, quint32 d)
+{
+    // two channels per 32 bit word, the sums of four bytes fit in 16 bits
+    const quint32 mask = 0x00FF00FF;
+    quint32 lo = (a & mask) + (b & mask) + (c & mask) + (d & mask) + 0x00020002;
+    quint32 hi = ((a >> 8) & mask) + ((b >> 8) & mask) + ((c >> 8) & mask) + ((d >> 8) & mask) + 0x00020002;
+    return ((lo >> 2) & mask) | (((hi >> 2) & mask) << 8);
+}
+
+void halveRgb32(quint32 *dst, const quint32 *src0, const quint32 *src1, int srcPixels)
+{
+    int i = 0;
+    for (; i + 1 < srcPixels; i += 2) {
+        dst[i / 2] = average4(src0[i], src0[i + 1], src1[i], src1[i + 1]);
+    }
+    if (i < srcPixels) {
+        dst[i / 2] = average4(src0[i], src0[i], src1[i], src1[i]);
+    }
+}
+
+void rgb32ToGray(uchar *dst, const quint32 *src, int pixels)
+{
+    kernels().rgb32ToGray(dst, src, pixels);
+}
+
+void edgeStrength(quint16 *dst, const uchar *above, const uchar *line, const uchar *below, int pixels, int trigger)
+{
+    int pix = line[0];
+    int diff = qAbs(pix - line[1]) + qAbs(pix - above[0]) + qAbs(pix - below[0]);
+    dst[0] = (quint16)((diff > trigger) ? diff : 0);
+
+    pix = line[pixels - 1];
+    diff = qAbs(pix - line[pixels - 2]) + qAbs(pix - above[pixels - 1]) + qAbs(pix - below[pixels - 1]);
+    dst[pixels - 1] = (quint16)((diff > trigger) ? diff : 0);
+
+    kernels().edgeStrength(dst, above, line, below, pixels, trigger);
+}
+
+qint64 addColumnSums(qint64 *sums, const quint16 *values, int pixels)
+{
+    return kernels().addColumnSums(sums, values, pixels);
+}
+
+const char *instructionSet()
+{
+    return kernels().name;
+}
+
+bool setInstructionSet(const char *name)
+{
+    if (name == 0) {
+        kernels() = selectKernels(s_instructionSetCount - 1);
+        return true;
+    }
+    for (int level = 0; level < s_instructionSetCount; ++level) {
+        if (strcmp(name, s_instructionSets[level]) == 0) {
+            kernels() = selectKernels(level);
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // NameSpace PixelOps
+}  // NameSpace KSaneIface
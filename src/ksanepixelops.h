@@ -0,0 +1,115 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+#ifndef KSANE_PIXEL_OPS_H
+#define KSANE_PIXEL_OPS_H
+
+#include <QtGlobal>
+
+namespace KSaneIface
+{
+
+/** Pixel conversion kernels shared by the scan and preview threads.
+ * The best implementation for the running CPU is selected on the first call. */
+namespace PixelOps
+{
+
+/** Invert the image data in place.
+ * 0xFF - x, 0xFFFF - x and ~x are the same bitwise operation,
+ * so this works for 1, 8 and 16 bit data. */
+void invert(uchar *data, int size);
+
+/** Scatter the data of one three-pass color frame into interleaved RGB data.
+ * @param rgb is the start of the interleaved image.
+ * @param plane is the data read from the frame.
+ * @param frameOffset is the byte offset of @p plane inside the frame.
+ * @param size is the number of bytes in @p plane.
+ * @param depth is the number of bits per sample (8 or 16).
+ * @param channel is 0 for red, 1 for green and 2 for blue. */
+void mergePlane(uchar *rgb, const uchar *plane, qint64 frameOffset, int size, int depth, int channel);
+
+/** Expand one line of line-art to QImage::Format_RGB32 pixels.
+ * A set bit is black. The most significant bit is the leftmost pixel. */
+void monoToRgb32(quint32 *dst, const uchar *src, int pixels);
+
+/** Expand one line of gray samples to QImage::Format_RGB32 pixels.
+ * For 16 bit samples the byte at offset 1 of each sample is used. */
+void grayToRgb32(quint32 *dst, const uchar *src, int pixels, int depth);
+
+/** Expand one line of interleaved RGB samples to QImage::Format_RGB32 pixels.
+ * For 16 bit samples the byte at offset 1 of each sample is used. */
+void rgbToRgb32(quint32 *dst, const uchar *src, int pixels, int depth);
+
+/** Write one line of a three-pass color frame into one channel of
+ * QImage::Format_RGB32 pixels. The other channels are kept.
+ * @param channel is 0 for red, 1 for green and 2 for blue. */
+void planeToRgb32(quint32 *dst, const uchar *src, int pixels, int depth, int channel);
+
+/** Copy 16 bit samples and convert them to the byte order of the host.
+ * @param bigEndian tells the byte order of the samples in @p src. */
+void samples16ToHost(quint16 *dst, const uchar *src, int samples, bool bigEndian);
+
+/** Expand one line of interleaved 16 bit RGB samples to QImage::Format_RGBX64
+ * pixels (red, green, blue and 0xFFFF in the byte order of the host).
+ * @param bigEndian tells the byte order of the samples in @p src. */
+void rgb48ToRgbx64(quint16 *dst, const uchar *src, int pixels, bool bigEndian);
+
+/** Scale two lines of 32 bit pixels down to one line of half the width.
+ * Each destination pixel is the rounded average of a 2x2 block.
+ * @param dst receives (srcPixels + 1) / 2 pixels. The last column is
+ * repeated when @p srcPixels is odd. */
+void halveRgb32(quint32 *dst, const quint32 *src0, const quint32 *src1, int srcPixels);
+
+/** Convert 32 bit pixels to gray with the weights of qGray(). */
+void rgb32ToGray(uchar *dst, const quint32 *src, int pixels);
+
+/** Sum the absolute differences of each gray pixel to its four neighbours.
+ * The first and the last pixel of the line have only three neighbours.
+ * Sums that are not above @p trigger are set to 0.
+ * @param pixels must be at least 2.
+ * @param trigger must not be negative. */
+void edgeStrength(quint16 *dst, const uchar *above, const uchar *line, const uchar *below, int pixels, int trigger);
+
+/** Add a line of values to the column sums.
+ * @return the sum of the line. */
+qint64 addColumnSums(qint64 *sums, const quint16 *values, int pixels);
+
+/** The name of the best instruction set used by the kernels
+ * ("avx2", "ssse3", "sse2", "neon" or "scalar"). */
+const char *instructionSet();
+
+/** Use only the kernels of @p name and of the instruction sets before it in
+ * "scalar", "sse2", "ssse3", "avx2", "neon". 0 selects the best kernels again.
+ * This is meant for tests and benchmarks and must not be called while any
+ * kernel is running.
+ * @return false if @p name is not known. */
+bool setInstructionSet(const char *name);
+
+}
+}
+
+#endif
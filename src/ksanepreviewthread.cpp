@@ -28,33 +28,43 @@
 
 #include "ksanepreviewthread.h"
 
-#include <QMutexLocker>
+#include <QElapsedTimer>
 #include <QDebug>
 #include <QImage>
 
+#include "ksanepixelops.h"
+
 namespace KSaneIface
 {
-KSanePreviewThread::KSanePreviewThread(SANE_Handle handle, QImage *img):
+KSanePreviewThread::KSanePreviewThread(SANE_Handle handle, KSaneReadTuner *readTuner, KSaneStatsRecorder *stats):
     QThread(),
     status(SANE_STATUS_GOOD),
     m_frameSize(0),
     m_frameRead(0),
     m_dataSize(0),
     m_frame_t_count(0),
-    m_pixel_x(0),
-    m_pixel_y(0),
-    m_px_c_index(0),
-    m_img(img),
+    m_line(0),
+    m_lineFill(0),
+    m_linesDone(0),
+    m_shownLines(0),
+    m_image(0),
+    m_imageBits(0),
+    m_imageBytesPerLine(0),
+    m_imageHeight(0),
     m_saneHandle(handle),
+    m_readTuner(readTuner),
+    m_stats(stats),
     m_invertColors(false),
     m_readStatus(READ_READY),
 //    m_scanProgress(0),
-    m_saneStartDone(false),
-    m_imageResized(false)
+    m_saneStartDone(false)
+{}
+
+KSanePreviewThread::~KSanePreviewThread()
 {
-    m_px_colors[0] = 0;
-    m_px_colors[1] = 0;
-    m_px_colors[2] = 0;
+    wait();
+    qDeleteAll(m_retiredImages);
+    delete m_image.load();
 }
 
 void KSanePreviewThread::setPreviewInverted(bool inverted)
@@ -65,6 +75,7 @@ void KSanePreviewThread::setPreviewInverted(bool inverted)
 void KSanePreviewThread::cancelScan()
 {
     m_readStatus = READ_CANCEL;
+    m_ioWaiter.cancel();
 }
 
 void KSanePreviewThread::run()
@@ -72,23 +83,30 @@ void KSanePreviewThread::run()
     m_dataSize = 0;
     m_readStatus = READ_ON_GOING;
     m_saneStartDone = false;
+    m_ioWaiter.reset();
+    m_stats->start(true);
 
     // Start the scanning with sane_start
     status = sane_start(m_saneHandle);
+    m_stats->startDone();
 
     if (status != SANE_STATUS_GOOD) {
         qDebug() << "sane_start=" << sane_strstatus(status);
         sane_cancel(m_saneHandle);
         m_readStatus = READ_ERROR;
+        m_stats->finish(false);
         return;
     }
 
+    m_ioWaiter.setNonBlocking(m_saneHandle);
+
     // Read image parameters
     status = sane_get_parameters(m_saneHandle, &m_params);
     if (status != SANE_STATUS_GOOD) {
         qDebug() << "sane_get_parameters=" << sane_strstatus(status);
         sane_cancel(m_saneHandle);
         m_readStatus = READ_ERROR;
+        m_stats->finish(false);
         return;
     }
 
@@ -103,31 +121,31 @@ void KSanePreviewThread::run()
         m_dataSize = m_frameSize;
     }
 
-    // create a new image if necessary
-    if ((m_img->height() != m_params.lines) ||
-            (m_img->width()  != m_params.pixels_per_line)) {
-        // just hope that the frame size is not changed between different frames of the same image.
-        if (m_params.lines > 0) {
-            *m_img = QImage(m_params.pixels_per_line, m_params.lines, QImage::Format_RGB32);
-        } else {
-            // handscanners have the number of lines -1 -> make room for something
-            *m_img = QImage(m_params.pixels_per_line, m_params.pixels_per_line, QImage::Format_RGB32);
-        }
-        m_img->fill(0xFFFFFFFF);
-    }
-    m_imageResized = false;
-    m_pixel_x     = 0;
-    m_pixel_y     = 0;
+    // The images retired during the previous preview have been replaced in
+    // the GUI long ago, so they can be freed now.
+    qDeleteAll(m_retiredImages);
+    m_retiredImages.clear();
+
+    // just hope that the frame size is not changed between different frames of the same image.
+    // handscanners have the number of lines -1 -> make room for something
+    createImage(m_params.pixels_per_line, (m_params.lines > 0) ? m_params.lines : m_params.pixels_per_line);
+    m_linesDone.storeRelease(0);
+    m_line        = 0;
+    m_lineFill    = 0;
     m_frameRead   = 0;
-    m_px_c_index  = 0;
     m_frame_t_count = 0;
 
     // set the m_saneStartDone here so the new QImage gets allocated before updating the preview.
     m_saneStartDone = true;
 
+    m_stats->setImageMemory((qint64)m_imageBytesPerLine * m_imageHeight);
     while (m_readStatus == READ_ON_GOING) {
         readData();
     }
+    m_stats->finish(m_readStatus == READ_READY);
+    if (m_readStatus == READ_READY) {
+        m_readTuner->save();
+    }
 }
 
 int KSanePreviewThread::scanProgress()
@@ -151,7 +169,22 @@ int KSanePreviewThread::scanProgress()
 void KSanePreviewThread::readData()
 {
     SANE_Int readBytes;
-    status = sane_read(m_saneHandle, m_readData, PREVIEW_READ_CHUNK_SIZE, &readBytes);
+    if (m_ioWaiter.isNonBlocking() && !m_ioWaiter.waitForData()) {
+        // canceled
+        return;
+    }
+    int size = m_readTuner->chunkSize();
+    if (m_readData.size() < size) {
+        m_readData.resize(size);
+        m_stats->setReadMemory(m_readData.capacity());
+    }
+    QElapsedTimer readTimer;
+    readTimer.start();
+    status = sane_read(m_saneHandle, m_readData.data(), size, &readBytes);
+    if (!m_ioWaiter.isNonBlocking()) {
+        m_readTuner->addRead(size, readBytes, readTimer.nsecsElapsed() / 1000);
+    }
+    m_stats->addRead(readBytes, readTimer.nsecsElapsed() / 1000);
 
     switch (status) {
     case SANE_STATUS_GOOD:
@@ -184,11 +217,11 @@ void KSanePreviewThread::readData()
                 sane_cancel(m_saneHandle);
                 return;
             }
+            m_ioWaiter.setNonBlocking(m_saneHandle);
             //qDebug() << "New Frame";
             m_frameRead = 0;
-            m_pixel_x     = 0;
-            m_pixel_y     = 0;
-            m_px_c_index  = 0;
+            m_line        = 0;
+            m_lineFill    = 0;
             m_frame_t_count++;
             break;
         }
@@ -199,248 +232,149 @@ void KSanePreviewThread::readData()
         return;
     }
 
+    readTimer.start();
     copyToPreviewImg(readBytes);
+    m_stats->addConvert(readTimer.nsecsElapsed() / 1000);
+    m_stats->setImageMemory((qint64)m_imageBytesPerLine * m_imageHeight);
 }
 
-#define inc_pixel(x,y,ppl) { x++; if (x>=ppl) { y++; x=0;} }
-#define inc_color_index(index) { index++; if (index==3) index=0;}
+void KSanePreviewThread::createImage(int width, int height)
+{
+    QImage *current = m_image.load();
+    if (current && (current->width() == width) && (current->height() == height)) {
+        // The image may be shared with the GUI, so it is cleared through the
+        // stored pointer. bits() would detach it.
+        memset(m_imageBits, 0xFF, (size_t)m_imageBytesPerLine * m_imageHeight);
+        return;
+    }
 
-#define index_red8_to_argb8(i)   (i*4 + 2)
-#define index_red16_to_argb8(i)  (i*2 + 2)
+    QImage *img = new QImage(width, height, QImage::Format_RGB32);
+    img->fill(0xFFFFFFFF);
+    m_imageBits         = img->bits();
+    m_imageBytesPerLine = img->bytesPerLine();
+    m_imageHeight       = height;
+    m_image.storeRelease(img);
+    if (current) {
+        m_retiredImages.append(current);
+    }
+}
 
-#define index_green8_to_argb8(i)  (i*4 + 1)
-#define index_green16_to_argb8(i) (i*2 + 1)
+void KSanePreviewThread::growImage()
+{
+    // grow geometrically, so a long hand scanner preview is only copied a few times
+    QImage *current = m_image.load();
+    int height = qMax(current->height() * 2, current->height() + current->width());
+    QImage *img = new QImage(current->copy(0, 0, current->width(), height));
+    m_imageBits         = img->bits();
+    m_imageBytesPerLine = img->bytesPerLine();
+    m_imageHeight       = height;
+    m_image.storeRelease(img);
+    m_retiredImages.append(current);
+}
 
-#define index_blue8_to_argb8(i)  (i*4)
-#define index_blue16_to_argb8(i) (i*2)
+QImage KSanePreviewThread::image()
+{
+    QImage *img = m_image.loadAcquire();
+    return img ? *img : QImage();
+}
 
 void KSanePreviewThread::copyToPreviewImg(int read_bytes)
 {
-    QMutexLocker locker(&imgMutex);
-    int index;
-    uchar *imgBits = m_img->bits();
     if (m_invertColors) {
-        if (m_params.depth >= 8) {
-            for (int i = 0; i < read_bytes; i++) {
-                m_readData[i] = 255 - m_readData[i];
-            }
+        if ((m_params.depth >= 8) || (m_params.depth == 1)) {
+            PixelOps::invert(m_readData.data(), read_bytes);
         }
-        if (m_params.depth == 1) {
-            for (int i = 0; i < read_bytes; i++) {
-                m_readData[i] = ~m_readData[i];
-            }
+    }
+
+    bool supported;
+    switch (m_params.format) {
+    case SANE_FRAME_GRAY:
+        supported = (m_params.depth == 1) || (m_params.depth == 8) || (m_params.depth == 16);
+        break;
+    case SANE_FRAME_RGB:
+    case SANE_FRAME_RED:
+    case SANE_FRAME_GREEN:
+    case SANE_FRAME_BLUE:
+        supported = (m_params.depth == 8) || (m_params.depth == 16);
+        break;
+    default:
+        supported = false;
+    }
+    if (!supported || (m_params.bytes_per_line <= 0)) {
+        qWarning() << "Format" << m_params.format
+                   << "and depth" << m_params.depth
+                   << "is not yet suppoeted by libksane!";
+        m_readStatus = READ_ERROR;
+        return;
+    }
+
+    const int bytesPerLine = m_params.bytes_per_line;
+    const uchar *data = m_readData.constData();
+    m_frameRead += read_bytes;
+
+    // complete a line that was split between two reads
+    if (m_lineFill > 0) {
+        int bytes = qMin(read_bytes, bytesPerLine - m_lineFill);
+        memcpy(m_lineBuffer.data() + m_lineFill, data, bytes);
+        m_lineFill += bytes;
+        data       += bytes;
+        read_bytes -= bytes;
+        if (m_lineFill < bytesPerLine) {
+            return;
         }
+        convertLine(m_lineBuffer.constData());
+        m_lineFill = 0;
+    }
+
+    // whole lines are converted straight from the read buffer
+    while (read_bytes >= bytesPerLine) {
+        convertLine(data);
+        data       += bytesPerLine;
+        read_bytes -= bytesPerLine;
     }
+
+    if (read_bytes > 0) {
+        m_lineBuffer.resize(bytesPerLine);
+        memcpy(m_lineBuffer.data(), data, read_bytes);
+        m_lineFill = read_bytes;
+    }
+}
+
+void KSanePreviewThread::convertLine(const uchar *line)
+{
+    if (m_line >= m_imageHeight) {
+        // handscanners do not know the number of lines
+        growImage();
+    }
+    quint32 *dst = reinterpret_cast<quint32 *>(m_imageBits + (qint64)m_line * m_imageBytesPerLine);
+    int pixels = qMin(m_params.pixels_per_line, m_imageBytesPerLine / 4);
+
     switch (m_params.format) {
     case SANE_FRAME_GRAY:
         if (m_params.depth == 1) {
-            int i, j;
-            for (i = 0; i < read_bytes; i++) {
-                if (m_pixel_y >= m_img->height()) {
-                    // resize the image
-                    *m_img = m_img->copy(0, 0, m_img->width(), m_img->height() + m_img->width());
-                    m_imageResized = true;
-                }
-                for (j = 7; j >= 0; --j) {
-                    if ((m_readData[i] & (1 << j)) == 0) {
-                        m_img->setPixel(m_pixel_x,
-                                        m_pixel_y,
-                                        qRgb(255, 255, 255));
-                    } else {
-                        m_img->setPixel(m_pixel_x,
-                                        m_pixel_y,
-                                        qRgb(0, 0, 0));
-                    }
-                    m_pixel_x++;
-                    if (m_pixel_x >= m_params.pixels_per_line) {
-                        m_pixel_x = 0;
-                        m_pixel_y++;
-                        break;
-                    }
-                    if (m_pixel_y >= m_params.lines) {
-                        break;
-                    }
-                }
-                m_frameRead++;
-            }
-            return;
-        } else if (m_params.depth == 8) {
-            for (int i = 0; i < read_bytes; i++) {
-                index = m_frameRead * 4;
-                if ((index + 2) > m_img->byteCount()) {
-                    // resize the image
-                    *m_img = m_img->copy(0, 0, m_img->width(), m_img->height() + m_img->width());
-                    imgBits = m_img->bits();
-                    m_imageResized = true;
-                }
-                imgBits[index    ] = m_readData[i];
-                imgBits[index + 1] = m_readData[i];
-                imgBits[index + 2] = m_readData[i];
-                m_frameRead++;
-            }
-            return;
-        } else if (m_params.depth == 16) {
-            for (int i = 0; i < read_bytes; i++) {
-                if (m_frameRead % 2 == 0) {
-                    index = m_frameRead * 2;
-                    if ((index + 2) > m_img->byteCount()) {
-                        // resize the image
-                        *m_img = m_img->copy(0, 0, m_img->width(), m_img->height() + m_img->width());
-                        imgBits = m_img->bits();
-                        m_imageResized = true;
-                    }
-                    imgBits[index    ] = m_readData[i + 1];
-                    imgBits[index + 1] = m_readData[i + 1];
-                    imgBits[index + 2] = m_readData[i + 1];
-                }
-                m_frameRead++;
-            }
-            return;
+            PixelOps::monoToRgb32(dst, line, pixels);
+        } else {
+            PixelOps::grayToRgb32(dst, line, pixels, m_params.depth);
         }
         break;
-
     case SANE_FRAME_RGB:
-        if (m_params.depth == 8) {
-            for (int i = 0; i < read_bytes; i++) {
-                m_px_colors[m_px_c_index] = m_readData[i];
-                inc_color_index(m_px_c_index);
-                m_frameRead++;
-                if (m_px_c_index == 0) {
-                    if (m_pixel_y >= m_img->height()) {
-                        // resize the image
-                        *m_img = m_img->copy(0, 0, m_img->width(), m_img->height() + m_img->width());
-                        m_imageResized = true;
-                    }
-                    m_img->setPixel(m_pixel_x,
-                                    m_pixel_y,
-                                    qRgb(m_px_colors[0],
-                                         m_px_colors[1],
-                                         m_px_colors[2]));
-                    inc_pixel(m_pixel_x, m_pixel_y, m_params.pixels_per_line);
-                }
-            }
-            return;
-        } else if (m_params.depth == 16) {
-            for (int i = 0; i < read_bytes; i++) {
-                m_frameRead++;
-                if (m_frameRead % 2 == 0) {
-                    m_px_colors[m_px_c_index] = m_readData[i];
-                    inc_color_index(m_px_c_index);
-                    if (m_px_c_index == 0) {
-                        if (m_pixel_y >= m_img->height()) {
-                            // resize the image
-                            *m_img = m_img->copy(0, 0, m_img->width(), m_img->height() + m_img->width());
-                            m_imageResized = true;
-                        }
-                        m_img->setPixel(m_pixel_x,
-                                        m_pixel_y,
-                                        qRgb(m_px_colors[0],
-                                             m_px_colors[1],
-                                             m_px_colors[2]));
-                        inc_pixel(m_pixel_x, m_pixel_y, m_params.pixels_per_line);
-                    }
-                }
-            }
-            return;
-        }
+        PixelOps::rgbToRgb32(dst, line, pixels, m_params.depth);
         break;
-
     case SANE_FRAME_RED:
-        if (m_params.depth == 8) {
-            for (int i = 0; i < read_bytes; i++) {
-                if (index_red8_to_argb8(m_frameRead) > m_img->byteCount()) {
-                    // resize the image
-                    *m_img = m_img->copy(0, 0, m_img->width(), m_img->height() + m_img->width());
-                    imgBits = m_img->bits();
-                    m_imageResized = true;
-                }
-                imgBits[index_red8_to_argb8(m_frameRead)] = m_readData[i];
-                m_frameRead++;
-            }
-            return;
-        } else if (m_params.depth == 16) {
-            for (int i = 0; i < read_bytes; i++) {
-                if (m_frameRead % 2 == 0) {
-                    if (index_red16_to_argb8(m_frameRead) > m_img->byteCount()) {
-                        // resize the image
-                        *m_img = m_img->copy(0, 0, m_img->width(), m_img->height() + m_img->width());
-                        imgBits = m_img->bits();
-                        m_imageResized = true;
-                    }
-                    imgBits[index_red16_to_argb8(m_frameRead)] = m_readData[i + 1];
-                }
-                m_frameRead++;
-            }
-            return;
-        }
+        PixelOps::planeToRgb32(dst, line, pixels, m_params.depth, 0);
         break;
-
     case SANE_FRAME_GREEN:
-        if (m_params.depth == 8) {
-            for (int i = 0; i < read_bytes; i++) {
-                if (index_green8_to_argb8(m_frameRead) > m_img->byteCount()) {
-                    // resize the image
-                    *m_img = m_img->copy(0, 0, m_img->width(), m_img->height() + m_img->width());
-                    imgBits = m_img->bits();
-                    m_imageResized = true;
-                }
-                imgBits[index_green8_to_argb8(m_frameRead)] = m_readData[i];
-                m_frameRead++;
-            }
-            return;
-        } else if (m_params.depth == 16) {
-            for (int i = 0; i < read_bytes; i++) {
-                if (m_frameRead % 2 == 0) {
-                    if (index_green16_to_argb8(m_frameRead) > m_img->byteCount()) {
-                        // resize the image
-                        *m_img = m_img->copy(0, 0, m_img->width(), m_img->height() + m_img->width());
-                        imgBits = m_img->bits();
-                        m_imageResized = true;
-                    }
-                    imgBits[index_green16_to_argb8(m_frameRead)] = m_readData[i + 1];
-                }
-                m_frameRead++;
-            }
-            return;
-        }
+        PixelOps::planeToRgb32(dst, line, pixels, m_params.depth, 1);
         break;
-
     case SANE_FRAME_BLUE:
-        if (m_params.depth == 8) {
-            for (int i = 0; i < read_bytes; i++) {
-                if (index_blue8_to_argb8(m_frameRead) > m_img->byteCount()) {
-                    // resize the image
-                    *m_img = m_img->copy(0, 0, m_img->width(), m_img->height() + m_img->width());
-                    imgBits = m_img->bits();
-                    m_imageResized = true;
-                }
-                imgBits[index_blue8_to_argb8(m_frameRead)] = m_readData[i];
-                m_frameRead++;
-            }
-            return;
-        } else if (m_params.depth == 16) {
-            for (int i = 0; i < read_bytes; i++) {
-                if (m_frameRead % 2 == 0) {
-                    if (index_blue16_to_argb8(m_frameRead) > m_img->byteCount()) {
-                        // resize the image
-                        *m_img = m_img->copy(0, 0, m_img->width(), m_img->height() + m_img->width());
-                        imgBits = m_img->bits();
-                        m_imageResized = true;
-                    }
-                    imgBits[index_blue16_to_argb8(m_frameRead)] = m_readData[i + 1];
-                }
-                m_frameRead++;
-            }
-            return;
-        }
+        PixelOps::planeToRgb32(dst, line, pixels, m_params.depth, 2);
+        break;
+    default:
         break;
     }
 
-    qWarning() << "Format" << m_params.format
-               << "and depth" << m_params.format
-               << "is not yet suppoeted by libksane!";
-    m_readStatus = READ_ERROR;
-    return;
+    m_line++;
+    m_linesDone.storeRelease((m_frame_t_count << 24) | m_line);
 }
 
 bool KSanePreviewThread::saneStartDone()
@@ -448,13 +382,25 @@ bool KSanePreviewThread::saneStartDone()
     return   m_saneStartDone;
 }
 
-bool KSanePreviewThread::imageResized()
+bool KSanePreviewThread::takeDirtyLines(int &firstLine, int &lastLine)
 {
-    if (m_imageResized) {
-        m_imageResized = false;
-        return true;
+    int done = m_linesDone.loadAcquire();
+    if (done == m_shownLines) {
+        return false;
+    }
+    int lines = done & 0xFFFFFF;
+    int shown = m_shownLines & 0xFFFFFF;
+    if (((done >> 24) != (m_shownLines >> 24)) || (lines < shown)) {
+        // a new frame or a new preview -> the whole image
+        QImage *img = m_image.loadAcquire();
+        firstLine = 0;
+        lastLine  = img ? img->height() - 1 : lines - 1;
+    } else {
+        firstLine = shown;
+        lastLine  = lines - 1;
     }
-    return false;
+    m_shownLines = done;
+    return true;
 }
 
 }  // NameSpace KSaneIface
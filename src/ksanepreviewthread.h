@@ -36,13 +36,24 @@ extern "C"
 }
 
 #include <QThread>
-#include <QMutex>
 #include <QImage>
+#include <QVector>
+#include <QList>
+#include <QAtomicInt>
+#include <QAtomicPointer>
 
-#define PREVIEW_READ_CHUNK_SIZE 100000
+#include "ksanereadtuner.h"
+#include "ksaneiowaiter.h"
+#include "ksanestatsrecorder.h"
 
 namespace KSaneIface
 {
+
+/** The preview is converted straight into the memory of a QImage that is
+ * shared with the GUI thread without any locks. The number of complete
+ * lines is published with an atomic watermark. When a hand scanner preview
+ * outgrows the image, a bigger copy is published and the old one is kept
+ * alive until the next preview, so the GUI never sees freed memory. */
 class KSanePreviewThread: public QThread
 {
     Q_OBJECT
@@ -54,38 +65,54 @@ public:
         READ_READY
     } ReadStatus;
 
-    KSanePreviewThread(SANE_Handle handle, QImage *img);
+    KSanePreviewThread(SANE_Handle handle, KSaneReadTuner *readTuner, KSaneStatsRecorder *stats);
+    ~KSanePreviewThread();
     void run();
     void setPreviewInverted(bool);
     void cancelScan();
     int scanProgress();
     bool saneStartDone();
-    bool imageResized();
+    /** @return the image the preview is drawn into. The pixel data keeps
+     * changing while the preview is ongoing. */
+    QImage image();
+    /** Get the range of image lines that were completed since the last call.
+     * This is only called from the GUI thread.
+     * @return false if no line has changed. */
+    bool takeDirtyLines(int &firstLine, int &lastLine);
 
     SANE_Status status;
-    QMutex imgMutex;
 
 private:
     void readData();
     void copyToPreviewImg(int readBytes);
+    void convertLine(const uchar *line);
+    void createImage(int width, int height);
+    void growImage();
 
-    SANE_Byte       m_readData[PREVIEW_READ_CHUNK_SIZE];
+    QVector<SANE_Byte> m_readData;
     int             m_frameSize;
     int             m_frameRead;
     int             m_dataSize;
     int             m_frame_t_count;
-    int             m_pixel_x;
-    int             m_pixel_y;
-    int             m_px_colors[3];
-    int             m_px_c_index;
+    int             m_line;       ///< next image line to convert
+    QVector<uchar>  m_lineBuffer; ///< a line that is split between two reads
+    int             m_lineFill;
+    QAtomicInt      m_linesDone;  ///< (frame << 24) | complete lines of the frame
+    int             m_shownLines; ///< m_linesDone at the last takeDirtyLines()
     SANE_Parameters m_params;
-    QImage          *m_img;
+    QAtomicPointer<QImage> m_image;
+    QList<QImage *> m_retiredImages;
+    uchar          *m_imageBits;
+    int             m_imageBytesPerLine;
+    int             m_imageHeight;
     SANE_Handle     m_saneHandle;
+    KSaneReadTuner *m_readTuner;
+    KSaneStatsRecorder *m_stats;
+    KSaneIoWaiter   m_ioWaiter;
     bool            m_invertColors;
     ReadStatus      m_readStatus;
 //            int             m_scanProgress;
     bool            m_saneStartDone;
-    bool            m_imageResized;
 };
 }
 
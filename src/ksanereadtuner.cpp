@@ -0,0 +1,158 @@
+/* ============================================================
+*
+* This file is part of the KDE project
+*
+* Date        : 2026-10-17
+* Description : Sane interface for KDE
+*
+* Copyright (C) 2026 by the KSane developers
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) version 3, or any
+* later version accepted by the membership of KDE e.V. (or its
+* successor approved by the membership of KDE e.V.), which shall
+* act as a proxy defined in Section 6 of version 3 of the license.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+* ============================================================ */
+
+#include "ksanereadtuner.h"
+
+#include <QSettings>
+#include <QMutexLocker>
+#include <QDebug>
+
+// number of reads the decision is based on
+#define TUNE_READS 8
+// a full read faster than this is a sign that a bigger request pays off
+#define TUNE_FAST_READ_USEC 20000
+// a read slower than this makes the progress and cancel sluggish
+#define TUNE_SLOW_READ_USEC 200000
+
+namespace KSaneIface
+{
+
+static int roundedSize(qint64 size)
+{
+    size = ((size + READ_CHUNK_MIN_SIZE - 1) / READ_CHUNK_MIN_SIZE) * READ_CHUNK_MIN_SIZE;
+    return (int)qBound((qint64)READ_CHUNK_MIN_SIZE, size, (qint64)READ_CHUNK_MAX_SIZE);
+}
+
+static QString settingsKey(const QString &deviceName)
+{
+    // QSettings uses '/' as the group separator
+    QString key = deviceName;
+    return key.replace(QLatin1Char('/'), QLatin1Char('_'));
+}
+
+KSaneReadTuner::KSaneReadTuner():
+    m_size(READ_CHUNK_DEFAULT_SIZE),
+    m_fixedSize(0),
+    m_reads(0),
+    m_received(0),
+    m_usecs(0),
+    m_changed(false)
+{}
+
+void KSaneReadTuner::setDevice(const QString &deviceName)
+{
+    QMutexLocker locker(&m_mutex);
+    m_deviceName = deviceName;
+    m_size       = READ_CHUNK_DEFAULT_SIZE;
+    m_reads      = 0;
+    m_received   = 0;
+    m_usecs      = 0;
+    m_changed    = false;
+
+    if (m_deviceName.isEmpty()) {
+        return;
+    }
+    QSettings settings(QStringLiteral("KDE"), QStringLiteral("libksane"));
+    settings.beginGroup(QStringLiteral("ReadChunkSize"));
+    int size = settings.value(settingsKey(m_deviceName), 0).toInt();
+    if (size > 0) {
+        m_size = roundedSize(size);
+    }
+}
+
+void KSaneReadTuner::setFixedSize(int size)
+{
+    QMutexLocker locker(&m_mutex);
+    m_fixedSize = (size > 0) ? size : 0;
+}
+
+int KSaneReadTuner::fixedSize()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_fixedSize;
+}
+
+int KSaneReadTuner::chunkSize()
+{
+    QMutexLocker locker(&m_mutex);
+    return (m_fixedSize > 0) ? m_fixedSize : m_size;
+}
+
+void KSaneReadTuner::addRead(int requested, int received, qint64 usecs)
+{
+    QMutexLocker locker(&m_mutex);
+    if ((m_fixedSize > 0) || (requested != m_size) || (received == 0)) {
+        // a short last read of the image says nothing about the backend and
+        // SANE_STATUS_GOOD with no data is allowed at any time
+        return;
+    }
+    m_received  += received;
+    m_usecs     += usecs;
+    if (++m_reads >= TUNE_READS) {
+        tune();
+    }
+}
+
+void KSaneReadTuner::save()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_changed || m_deviceName.isEmpty()) {
+        return;
+    }
+    QSettings settings(QStringLiteral("KDE"), QStringLiteral("libksane"));
+    settings.beginGroup(QStringLiteral("ReadChunkSize"));
+    settings.setValue(settingsKey(m_deviceName), m_size);
+    m_changed = false;
+}
+
+void KSaneReadTuner::tune()
+{
+    qint64 avgReceived = m_received / m_reads;
+    qint64 avgUsecs    = m_usecs / m_reads;
+    int size = m_size;
+
+    if (avgUsecs > TUNE_SLOW_READ_USEC) {
+        size = roundedSize(m_size / 2);
+    } else if ((avgReceived * 10 >= (qint64)m_size * 9) && (avgUsecs < TUNE_FAST_READ_USEC)) {
+        // the reads are (nearly) full and fast -> ask for more
+        size = roundedSize((qint64)m_size * 2);
+    } else if (avgReceived * 4 < m_size) {
+        // the backend hands out small pieces whatever we ask for
+        size = roundedSize(avgReceived * 2);
+    }
+
+    if (size != m_size) {
+        //qDebug() << "read size" << m_size << "->" << size << "received" << avgReceived << "in" << avgUsecs << "us";
+        m_size = size;
+        m_changed = true;
+    }
+    m_reads     = 0;
+    m_received  = 0;
+    m_usecs     = 0;
+}
+
+}  // NameSpace KSaneIface
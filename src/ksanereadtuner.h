@@ -0,0 +1,87 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+#ifndef KSANE_READ_TUNER_H
+#define KSANE_READ_TUNER_H
+
+#include <QString>
+#include <QMutex>
+
+#define READ_CHUNK_DEFAULT_SIZE 100000
+#define READ_CHUNK_MIN_SIZE     4096
+#define READ_CHUNK_MAX_SIZE     (1024 * 1024)
+
+namespace KSaneIface
+{
+
+/** Chooses the number of bytes requested per sane_read() call.
+ * Network backends return more data per call when asked for more, while
+ * slow USB backends block for a long time on big requests. The size is
+ * adapted from the observed bytes and time per call and is remembered per
+ * device name between sessions. A fixed size disables the adaptation. */
+class KSaneReadTuner
+{
+public:
+    KSaneReadTuner();
+
+    /** Load the size that was tuned for @p deviceName in an earlier session. */
+    void setDevice(const QString &deviceName);
+
+    /** Use @p size bytes for every read. 0 turns the adaptation back on. */
+    void setFixedSize(int size);
+    int fixedSize();
+
+    /** @return the number of bytes to request in the next sane_read(). */
+    int chunkSize();
+
+    /** Report the outcome of one blocking sane_read() call. Non-blocking reads
+     * only return what happens to be buffered, so they are not reported.
+     * Empty reads are ignored.
+     * @param requested is the number of bytes that were asked for.
+     * @param received is the number of bytes that were returned.
+     * @param usecs is the time the call took in microseconds. */
+    void addRead(int requested, int received, qint64 usecs);
+
+    /** Store the tuned size for the current device. */
+    void save();
+
+private:
+    void tune();
+
+    QMutex   m_mutex;
+    QString  m_deviceName;
+    int      m_size;
+    int      m_fixedSize;
+    int      m_reads;
+    qint64   m_received;
+    qint64   m_usecs;
+    bool     m_changed;
+};
+
+}
+
+#endif
@@ -28,30 +28,108 @@
 
 #include "ksanescanthread.h"
 
+#include <QElapsedTimer>
 #include <QDebug>
 
+#include <limits>
+
+#include "ksanepixelops.h"
+
+// time to back off when the ring is full or empty
+#define RING_WAIT_USEC 500
+
+// smaller skews are not worth the rotation of the whole image (degrees)
+#define MIN_DESKEW_ANGLE 0.1
+
 namespace KSaneIface
 {
 
-KSaneScanThread::KSaneScanThread(SANE_Handle handle, QByteArray *data):
+class KSaneReadThread: public QThread
+{
+public:
+    explicit KSaneReadThread(KSaneScanThread *scanThread): m_scanThread(scanThread) {}
+    void run()
+    {
+        m_scanThread->readLoop();
+    }
+
+private:
+    KSaneScanThread *m_scanThread;
+};
+
+KSaneScanThread::KSaneScanThread(SANE_Handle handle, QByteArray *data, KSaneReadTuner *readTuner,
+                                 KSaneStatsRecorder *stats):
     QThread(),
+    m_ring(SCAN_READ_CHUNK_COUNT, READ_CHUNK_DEFAULT_SIZE),
+    m_readThread(new KSaneReadThread(this)),
+    m_readDone(0),
     m_data(data),
+    m_outputSize(0),
     m_saneHandle(handle),
+    m_readTuner(readTuner),
+    m_stats(stats),
+    m_encoder(0),
+    m_deskewAngle(0),
     m_frameSize(0),
     m_frameRead(0),
     m_frame_t_count(0),
+    m_readFrameRead(0),
+    m_readFrame(0),
     m_dataSize(0),
     m_saneStatus(SANE_STATUS_GOOD),
     m_readStatus(READ_READY),
+    m_stripLines(0),
     m_invertColors(false),
+    m_progressive(false),
+    m_toFile(false),
+    m_segmented(false),
+    m_deskewing(false),
+    m_imageTooLarge(false),
     m_saneStartDone(false)
 {}
 
+KSaneScanThread::~KSaneScanThread()
+{
+    m_readThread->wait();
+    delete m_readThread;
+}
+
 void KSaneScanThread::setImageInverted(bool inverted)
 {
     m_invertColors = inverted;
 }
 
+void KSaneScanThread::setProgressive(bool progressive)
+{
+    m_progressive = progressive;
+}
+
+void KSaneScanThread::setOutputFile(bool enable, const QString &fileName)
+{
+    m_toFile = enable;
+    m_outputFileName = fileName;
+}
+
+QString KSaneScanThread::outputFileName()
+{
+    return m_toFile ? m_fileSink.fileName() : QString();
+}
+
+qint64 KSaneScanThread::outputSize()
+{
+    return m_outputSize;
+}
+
+void KSaneScanThread::setEncoder(KSaneImageEncoder *encoder)
+{
+    m_encoder = encoder;
+}
+
+void KSaneScanThread::setDeskewAngle(qreal angle)
+{
+    m_deskewAngle = angle;
+}
+
 SANE_Status KSaneScanThread::saneStatus()
 {
     return m_saneStatus;
@@ -59,12 +137,24 @@ SANE_Status KSaneScanThread::saneStatus()
 
 KSaneScanThread::ReadStatus KSaneScanThread::frameStatus()
 {
-    return m_readStatus;
+    return readStatus();
+}
+
+KSaneScanThread::ReadStatus KSaneScanThread::readStatus() const
+{
+    return (ReadStatus)m_readStatus.loadAcquire();
+}
+
+bool KSaneScanThread::setReadStatus(ReadStatus status)
+{
+    return m_readStatus.testAndSetOrdered(READ_ON_GOING, status);
 }
 
 void KSaneScanThread::cancelScan()
 {
-    m_readStatus = READ_CANCEL;
+    setReadStatus(READ_CANCEL);
+    // do not wait for a slow backend to return the current read
+    m_ioWaiter.cancel();
 }
 
 int KSaneScanThread::scanProgress()
@@ -73,7 +163,7 @@ int KSaneScanThread::scanProgress()
         return 0;
     }
 
-    int bytesRead;
+    qint64 bytesRead;
 
     if (m_frameSize < m_dataSize) {
         bytesRead = m_frameRead + (m_frameSize * m_frame_t_count);
@@ -88,39 +178,58 @@ SANE_Parameters KSaneScanThread::saneParameters()
     return m_params;
 }
 
+SANE_Parameters KSaneScanThread::imageParameters()
+{
+    return m_imageParams;
+}
+
+int KSaneScanThread::stripLines()
+{
+    return m_stripLines;
+}
+
 void KSaneScanThread::run()
 {
     m_dataSize = 0;
-    m_readStatus = READ_ON_GOING;
+    m_imageTooLarge = false;
+    m_readStatus.storeRelease(READ_ON_GOING);
     m_saneStartDone = false;
+    m_ioWaiter.reset();
+    m_stats->start(false);
 
     // Start the scanning with sane_start
     m_saneStatus = sane_start(m_saneHandle);
 
     m_saneStartDone = true;
+    m_stats->startDone();
 
-    if (m_readStatus == READ_CANCEL) {
+    if (readStatus() == READ_CANCEL) {
+        m_stats->finish(false);
         return;
     }
 
     if (m_saneStatus != SANE_STATUS_GOOD) {
         qDebug() << "sane_start=" << sane_strstatus(m_saneStatus);
-        m_readStatus = READ_ERROR;
+        setReadStatus(READ_ERROR);
+        m_stats->finish(false);
         // oneFinalScanDone() does the sane_cancel()
         return;
     }
 
+    m_ioWaiter.setNonBlocking(m_saneHandle);
+
     // Read image parameters
     m_saneStatus = sane_get_parameters(m_saneHandle, &m_params);
     if (m_saneStatus != SANE_STATUS_GOOD) {
         qDebug() << "sane_get_parameters=" << sane_strstatus(m_saneStatus);
-        m_readStatus = READ_ERROR;
+        setReadStatus(READ_ERROR);
+        m_stats->finish(false);
         // oneFinalScanDone() does the sane_cancel()
         return;
     }
 
     // calculate data size
-    m_frameSize  = m_params.lines * m_params.bytes_per_line;
+    m_frameSize  = (qint64)m_params.lines * m_params.bytes_per_line;
     if ((m_params.format == SANE_FRAME_RED) ||
             (m_params.format == SANE_FRAME_GREEN) ||
             (m_params.format == SANE_FRAME_BLUE)) {
@@ -129,23 +238,289 @@ void KSaneScanThread::run()
         m_dataSize = m_frameSize;
     }
 
+    // the rotation needs the height of the image to know the center
+    m_deskewing = (qAbs(m_deskewAngle) >= MIN_DESKEW_ANGLE) && !m_toFile &&
+                  KSaneDeskewer::canDeskew(m_params.depth, m_params.lines);
+
+    bool direct = directReadPossible();
+    bool threePass = (m_frameSize != m_dataSize);
+    // Hand scanners do not know the image size, so the data is collected in
+    // segments that are never moved. Progressive single-pass data is removed
+    // as soon as it is sent, so a QByteArray is fine for it.
+    m_segmented = (m_dataSize <= 0) && !m_toFile && (threePass || !m_progressive);
+
     m_data->clear();
-    if (m_dataSize > 0) {
-        m_data->reserve(m_dataSize);
+    m_segments.clear();
+    m_outputSize = 0;
+    // only progressive single-pass data is handed out before the image is complete
+    if ((threePass || !m_progressive) && !m_toFile && !checkByteArraySize(m_dataSize)) {
+        m_saneStatus = SANE_STATUS_NO_MEM;
+        m_stats->finish(false);
+        // oneFinalScanDone() does the sane_cancel()
+        return;
+    }
+    if (m_toFile) {
+        // the file is mapped as a whole, hand scanners grow it while reading
+        if (!m_fileSink.open(m_outputFileName, qMax(m_dataSize, (qint64)0))) {
+            m_saneStatus = SANE_STATUS_IO_ERROR;
+            setReadStatus(READ_ERROR);
+            m_stats->finish(false);
+            // oneFinalScanDone() does the sane_cancel()
+            return;
+        }
+    }
+    // In progressive mode the lines of single-pass frames are handed out
+    // as they are completed, so there is no need to reserve the whole image.
+    if (((m_frameSize < m_dataSize) || direct) && !m_toFile) {
+        // three-pass frames are merged in place and direct reads write at
+        // the read offset, so the whole image must exist
+        m_data->resize((int)m_dataSize);
+    } else if ((m_dataSize > 0) && !m_progressive && !m_toFile) {
+        m_data->reserve((int)m_dataSize);
     }
 
+    m_imageParams   = m_params;
+    m_readParams    = m_params;
+    m_stripLines    = 0;
     m_frameRead     = 0;
     m_frame_t_count = 0;
-    m_readStatus    = READ_ON_GOING;
-    while (m_readStatus == READ_ON_GOING) {
-        readData();
+    m_readFrameRead = 0;
+    m_readFrame     = 0;
+    m_ring.reset();
+    m_readDone.storeRelease(0);
+    if (m_progressive) {
+        emit imageStarted();
+    }
+    if (m_encoder) {
+        m_encoder->begin(m_params.pixels_per_line, m_params.lines, m_params.depth,
+                         (m_params.format == SANE_FRAME_GRAY) ? 1 : 3,
+                         threePass ? m_params.bytes_per_line * 3 : m_params.bytes_per_line);
+    }
+    m_deskewed.clear();
+    if (m_deskewing) {
+        m_deskewer.begin(m_params.pixels_per_line, m_params.lines, m_params.depth,
+                         (m_params.format == SANE_FRAME_GRAY) ? 1 : 3,
+                         threePass ? m_params.bytes_per_line * 3 : m_params.bytes_per_line,
+                         m_deskewAngle);
+        if (!m_progressive) {
+            m_deskewed.reserve((int)m_dataSize);
+        }
+    }
+
+    m_stats->setReadMemory(direct ? 0 : m_ring.memoryUsage());
+    if (direct) {
+        // nothing to convert -> no need for the second stage
+        readDirect();
+    } else {
+        m_readThread->start();
+        convertChunks();
+        m_readThread->wait();
+        // all data is converted, unless the reader or the converter failed
+        setReadStatus(READ_READY);
+    }
+    if (m_imageTooLarge) {
+        // the reader may have overwritten the status of the converter
+        m_saneStatus = SANE_STATUS_NO_MEM;
+    }
+
+    if (m_segmented) {
+        if (readStatus() == READ_READY) {
+            m_segments.moveTo(m_data);
+        }
+        m_segments.clear();
+    }
+
+    if (m_deskewing) {
+        if (readStatus() == READ_READY) {
+            int firstLine = m_deskewer.outputLines();
+            QByteArray rest = m_deskewer.finish();
+            handOutStrip(rest, firstLine, m_deskewer.outputLines() - firstLine);
+            if (!m_progressive) {
+                // the rotated lines replace the image
+                m_data->swap(m_deskewed);
+            }
+        } else {
+            m_deskewer.finish();
+        }
+        m_deskewed.clear();
+    }
+
+    if (m_encoder) {
+        m_encoder->finish(readStatus() == READ_READY);
+    }
+
+    m_stats->finish(readStatus() == READ_READY);
+    if (readStatus() == READ_READY) {
+        m_readTuner->save();
+    }
+
+    if (m_toFile) {
+        if (readStatus() == READ_READY) {
+            m_fileSink.close(m_outputSize);
+        } else {
+            m_fileSink.discard();
+        }
+    }
+
+    qint64 stallTime = m_stats->statistics().stallTime;
+    if (stallTime > 0) {
+        qDebug() << "The read thread waited" << stallTime << "ms for the conversion";
+    }
+}
+
+void KSaneScanThread::convertChunks()
+{
+    KSaneChunkRing::Chunk *chunk;
+    QElapsedTimer timer;
+    forever {
+        chunk = m_ring.readChunk();
+        if (chunk == 0) {
+            // check the ring again after the reader is done so that no chunk is lost
+            if (m_readDone.loadAcquire() && m_ring.isEmpty()) {
+                break;
+            }
+            QThread::usleep(RING_WAIT_USEC);
+            continue;
+        }
+
+        if (chunk->frame != m_frame_t_count) {
+            //qDebug() << "New Frame";
+            m_frameRead = 0;
+            m_frame_t_count = chunk->frame;
+        }
+        m_params = chunk->params;
+        if (readStatus() != READ_ERROR) {
+            timer.start();
+            copyToScanData(chunk->data.data(), chunk->bytes);
+            m_stats->addConvert(timer.nsecsElapsed() / 1000);
+            m_stats->setImageMemory(m_toFile ? 0 : m_segmented ? m_segments.memoryUsage() : m_data->capacity());
+
+            timer.start();
+            emitCompletedStrips();
+            m_stats->addEmit(timer.nsecsElapsed() / 1000);
+        }
+        m_ring.commitRead();
+    }
+}
+
+bool KSaneScanThread::directReadPossible()
+{
+    if (m_invertColors || m_progressive || m_encoder || m_deskewing || (m_dataSize <= 0) ||
+            (m_params.last_frame != SANE_TRUE)) {
+        // the strips are taken from the converted data
+        return false;
     }
+    if (!m_toFile && (m_dataSize > std::numeric_limits<int>::max())) {
+        // a QByteArray can not be pre-sized that large
+        return false;
+    }
+    if (m_params.format == SANE_FRAME_GRAY) {
+        return true;
+    }
+    return (m_params.format == SANE_FRAME_RGB) && (m_params.depth != 1);
 }
 
-void KSaneScanThread::readData()
+void KSaneScanThread::readDirect()
+{
+    uchar *image = m_toFile ? m_fileSink.data() : reinterpret_cast<uchar *>(m_data->data());
+    m_stats->setImageMemory(m_toFile ? 0 : m_data->capacity());
+    SANE_Byte extra[1024];
+    SANE_Int readBytes;
+    QElapsedTimer readTimer;
+
+    while (readStatus() == READ_ON_GOING) {
+        qint64 left = m_dataSize - m_frameRead;
+        readBytes = 0;
+        if (m_ioWaiter.isNonBlocking() && !m_ioWaiter.waitForData()) {
+            // canceled, cancelScan() has normally set the status already
+            setReadStatus(READ_CANCEL);
+            continue;
+        }
+        if (left > 0) {
+            int size = (int)qMin(left, (qint64)m_readTuner->chunkSize());
+            readTimer.start();
+            m_saneStatus = sane_read(m_saneHandle, image + m_frameRead, size, &readBytes);
+            if (!m_ioWaiter.isNonBlocking()) {
+                m_readTuner->addRead(size, readBytes, readTimer.nsecsElapsed() / 1000);
+            }
+            m_stats->addRead(readBytes, readTimer.nsecsElapsed() / 1000);
+        } else {
+            // the image is complete, but the backend still has to report EOF
+            m_saneStatus = sane_read(m_saneHandle, extra, sizeof(extra), &readBytes);
+        }
+
+        if ((m_saneStatus != SANE_STATUS_GOOD) && (m_saneStatus != SANE_STATUS_EOF)) {
+            qDebug() << "sane_read=" << m_saneStatus << "=" << sane_strstatus(m_saneStatus);
+            setReadStatus(READ_ERROR);
+            sane_cancel(m_saneHandle);
+            break;
+        }
+
+        if ((left <= 0) && (readBytes > 0)) {
+            qDebug() << "The backend sends more data than announced";
+            if (m_toFile) {
+                m_outputSize = m_frameRead;
+            }
+            appendImageData(extra, readBytes);
+            image = m_toFile ? m_fileSink.data() : reinterpret_cast<uchar *>(m_data->data());
+        }
+        m_frameRead += readBytes;
+
+        if (m_saneStatus == SANE_STATUS_EOF) {
+            if (m_frameRead < m_frameSize) {
+                qDebug() << "frameRead =" << m_frameRead  << ", frameSize =" << m_frameSize;
+                // It is better to return a broken image than nothing
+                if (!m_toFile) {
+                    m_data->resize((int)m_frameRead);
+                }
+            }
+            setReadStatus(READ_READY);
+        }
+    }
+    m_outputSize = m_frameRead;
+}
+
+void KSaneScanThread::readLoop()
+{
+    KSaneChunkRing::Chunk *chunk;
+    QElapsedTimer stallTimer;
+
+    while (readStatus() == READ_ON_GOING) {
+        chunk = m_ring.writeChunk();
+        if (chunk == 0) {
+            // the conversion is behind -> wait for a free chunk
+            stallTimer.start();
+            QThread::usleep(RING_WAIT_USEC);
+            m_stats->addStall(stallTimer.nsecsElapsed() / 1000);
+            continue;
+        }
+        if (!readData(chunk)) {
+            break;
+        }
+    }
+    m_readDone.storeRelease(1);
+}
+
+bool KSaneScanThread::readData(KSaneChunkRing::Chunk *chunk)
 {
     SANE_Int readBytes = 0;
-    m_saneStatus = sane_read(m_saneHandle, m_readData, SCAN_READ_CHUNK_SIZE, &readBytes);
+    if (m_ioWaiter.isNonBlocking() && !m_ioWaiter.waitForData()) {
+        // canceled, cancelScan() has normally set the status already
+        setReadStatus(READ_CANCEL);
+        return false;
+    }
+    int size = m_readTuner->chunkSize();
+    if (chunk->data.size() < size) {
+        chunk->data.resize(size);
+        m_stats->setReadMemory(m_ring.memoryUsage());
+    }
+    QElapsedTimer readTimer;
+    readTimer.start();
+    m_saneStatus = sane_read(m_saneHandle, chunk->data.data(), size, &readBytes);
+    if (!m_ioWaiter.isNonBlocking()) {
+        m_readTuner->addRead(size, readBytes, readTimer.nsecsElapsed() / 1000);
+    }
+    m_stats->addRead(readBytes, readTimer.nsecsElapsed() / 1000);
 
     switch (m_saneStatus) {
     case SANE_STATUS_GOOD:
@@ -153,134 +528,185 @@ void KSaneScanThread::readData()
         break;
 
     case SANE_STATUS_EOF:
-        if (m_frameRead < m_frameSize) {
-            qDebug() << "frameRead =" << m_frameRead  << ", frameSize =" << m_frameSize << "readBytes =" << readBytes;
-            if ((readBytes > 0) && ((m_frameRead + readBytes) <= m_frameSize)) {
+        if (m_readFrameRead < m_frameSize) {
+            qDebug() << "frameRead =" << m_readFrameRead  << ", frameSize =" << m_frameSize << "readBytes =" << readBytes;
+            if ((readBytes > 0) && ((m_readFrameRead + readBytes) <= m_frameSize)) {
                 qDebug() << "This is not a standard compliant backend";
-                copyToScanData(readBytes);
+                pushChunk(chunk, readBytes);
             }
-            m_readStatus = READ_READY; // It is better to return a broken image than nothing
-            return;
+            // It is better to return a broken image than nothing.
+            // run() sets READ_READY once the converter is done.
+            return false;
         }
-        if (m_params.last_frame == SANE_TRUE) {
+        if (m_readParams.last_frame == SANE_TRUE) {
             // this is where it all ends well :)
-            m_readStatus = READ_READY;
-            return;
+            return false;
         } else {
             // start reading next frame
             m_saneStatus = sane_start(m_saneHandle);
             if (m_saneStatus != SANE_STATUS_GOOD) {
                 qDebug() << "sane_start =" << sane_strstatus(m_saneStatus);
-                m_readStatus = READ_ERROR;
-                return;
+                setReadStatus(READ_ERROR);
+                return false;
             }
-            m_saneStatus = sane_get_parameters(m_saneHandle, &m_params);
+            m_saneStatus = sane_get_parameters(m_saneHandle, &m_readParams);
             if (m_saneStatus != SANE_STATUS_GOOD) {
                 qDebug() << "sane_get_parameters =" << sane_strstatus(m_saneStatus);
-                m_readStatus = READ_ERROR;
+                setReadStatus(READ_ERROR);
                 sane_cancel(m_saneHandle);
-                return;
+                return false;
             }
-            //qDebug() << "New Frame";
-            m_frameRead = 0;
-            m_frame_t_count++;
+            m_ioWaiter.setNonBlocking(m_saneHandle);
+            m_readFrameRead = 0;
+            m_readFrame++;
             break;
         }
     default:
         qDebug() << "sane_read=" << m_saneStatus << "=" << sane_strstatus(m_saneStatus);
-        m_readStatus = READ_ERROR;
+        setReadStatus(READ_ERROR);
         sane_cancel(m_saneHandle);
-        return;
+        return false;
     }
 
-    copyToScanData(readBytes);
+    pushChunk(chunk, readBytes);
+    return true;
+}
+
+void KSaneScanThread::pushChunk(KSaneChunkRing::Chunk *chunk, int readBytes)
+{
+    if (readBytes <= 0) {
+        return;
+    }
+    chunk->bytes  = readBytes;
+    chunk->frame  = m_readFrame;
+    chunk->params = m_readParams;
+    m_readFrameRead += readBytes;
+    m_ring.commitWrite();
 }
 
-#define index_red8_to_rgb8(i)     (i*3)
-#define index_red16_to_rgb16(i)   ((i/2)*6 + i%2)
+void KSaneScanThread::emitCompletedStrips()
+{
+    if ((!m_progressive && !m_encoder && !m_deskewing) || (readStatus() == READ_ERROR) ||
+            (m_params.bytes_per_line <= 0)) {
+        return;
+    }
+
+    bool threePass = ((m_params.format == SANE_FRAME_RED) ||
+                      (m_params.format == SANE_FRAME_GREEN) ||
+                      (m_params.format == SANE_FRAME_BLUE));
+
+    // the lines of a three-pass scan are complete only when the last color is read
+    if (threePass && (m_params.last_frame != SANE_TRUE)) {
+        return;
+    }
 
-#define index_green8_to_rgb8(i)   (i*3 + 1)
-#define index_green16_to_rgb16(i) ((i/2)*6 + i%2 + 2)
+    int doneLines = (int)(m_frameRead / m_params.bytes_per_line);
+    if (doneLines <= m_stripLines) {
+        return;
+    }
 
-#define index_blue8_to_rgb8(i)    (i*3 + 2)
-#define index_blue16_to_rgb16(i)  ((i/2)*6 + i%2 + 4)
+    int lineBytes = threePass ? m_params.bytes_per_line * 3 : m_params.bytes_per_line;
+    int lines     = doneLines - m_stripLines;
+    QByteArray strip;
+    if (m_toFile) {
+        strip = QByteArray((const char *)m_fileSink.data() + (qint64)m_stripLines * lineBytes, lines * lineBytes);
+    } else if (m_segmented) {
+        strip = m_segments.mid((qint64)m_stripLines * lineBytes, lines * lineBytes);
+    } else {
+        // progressive single-pass data is removed once it is sent, so the strip is always at the start
+        strip = QByteArray(m_data->constData() + ((threePass || !m_progressive) ? m_stripLines * lineBytes : 0),
+                           lines * lineBytes);
+    }
 
-void KSaneScanThread::copyToScanData(int readBytes)
+    if (m_deskewing) {
+        // the rotated lines lag behind the read lines
+        int firstLine = m_deskewer.outputLines();
+        QByteArray rotated = m_deskewer.addStrip(strip);
+        handOutStrip(rotated, firstLine, m_deskewer.outputLines() - firstLine);
+    } else {
+        handOutStrip(strip, m_stripLines, lines);
+    }
+    m_stripLines = doneLines;
+
+    if (m_progressive && !threePass && !m_toFile) {
+        m_data->remove(0, lines * lineBytes);
+    }
+}
+
+void KSaneScanThread::handOutStrip(const QByteArray &strip, int firstLine, int lines)
+{
+    if (lines <= 0) {
+        return;
+    }
+    if (m_encoder) {
+        m_encoder->addStrip(strip);
+    }
+    if (m_progressive) {
+        emit imageStripReady(strip, firstLine, lines);
+    } else if (m_deskewing) {
+        m_deskewed.append(strip);
+    }
+}
+
+void KSaneScanThread::copyToScanData(SANE_Byte *readData, int readBytes)
 {
     if (m_invertColors) {
-        if (m_params.depth == 16) {
-            //if (readBytes%2) qDebug() << "readBytes=" << readBytes;
-            quint16 *u16ptr = reinterpret_cast<quint16 *>(m_readData);
-            for (int i = 0; i < readBytes / 2; i++) {
-                u16ptr[i] = 0xFFFF - u16ptr[i];
-            }
-        } else if (m_params.depth == 8) {
-            for (int i = 0; i < readBytes; i++) {
-                m_readData[i] = 0xFF - m_readData[i];
-            }
-        } else if (m_params.depth == 1) {
-            for (int i = 0; i < readBytes; i++) {
-                m_readData[i] = ~m_readData[i];
-            }
+        if ((m_params.depth == 16) || (m_params.depth == 8) || (m_params.depth == 1)) {
+            // the inversion is byte wise, so a 16 bit sample split between two reads is fine
+            PixelOps::invert(readData, readBytes);
         }
     }
     switch (m_params.format) {
     case SANE_FRAME_GRAY:
-        m_data->append((const char *)m_readData, readBytes);
+        appendImageData(readData, readBytes);
         m_frameRead += readBytes;
         return;
     case SANE_FRAME_RGB:
         if (m_params.depth == 1) {
             break;
         }
-        m_data->append((const char *)m_readData, readBytes);
+        appendImageData(readData, readBytes);
         m_frameRead += readBytes;
         return;
 
     case SANE_FRAME_RED:
-        if (m_params.depth == 8) {
-            for (int i = 0; i < readBytes; i++) {
-                (*m_data)[index_red8_to_rgb8(m_frameRead)] = m_readData[i];
-                m_frameRead++;
-            }
-            return;
-        } else if (m_params.depth == 16) {
-            for (int i = 0; i < readBytes; i++) {
-                (*m_data)[index_red16_to_rgb16(m_frameRead)] = m_readData[i];
-                m_frameRead++;
-            }
-            return;
-        }
-        break;
-
     case SANE_FRAME_GREEN:
-        if (m_params.depth == 8) {
-            for (int i = 0; i < readBytes; i++) {
-                (*m_data)[index_green8_to_rgb8(m_frameRead)] = m_readData[i];
-                m_frameRead++;
-            }
-            return;
-        } else if (m_params.depth == 16) {
-            for (int i = 0; i < readBytes; i++) {
-                (*m_data)[index_green16_to_rgb16(m_frameRead)] = m_readData[i];
-                m_frameRead++;
-            }
-            return;
-        }
-        break;
-
     case SANE_FRAME_BLUE:
-        if (m_params.depth == 8) {
-            for (int i = 0; i < readBytes; i++) {
-                (*m_data)[index_blue8_to_rgb8(m_frameRead)] = m_readData[i];
-                m_frameRead++;
-            }
-            return;
-        } else if (m_params.depth == 16) {
-            for (int i = 0; i < readBytes; i++) {
-                (*m_data)[index_blue16_to_rgb16(m_frameRead)] = m_readData[i];
-                m_frameRead++;
+        if ((m_params.depth == 8) || (m_params.depth == 16)) {
+            int channel = (m_params.format == SANE_FRAME_RED) ? 0 :
+                          (m_params.format == SANE_FRAME_GREEN) ? 1 : 2;
+            // the interleaved data ends with the last sample of this read
+            int sampleBytes = m_params.depth / 8;
+            qint64 dataEnd = ((m_frameRead + readBytes + sampleBytes - 1) / sampleBytes) * 3 * sampleBytes;
+            uchar *rgb;
+            if (m_segmented) {
+                if (!checkByteArraySize(dataEnd)) {
+                    return;
+                }
+                m_segments.resize(dataEnd);
+                mergeSegmented(readData, readBytes, channel);
+                m_frameRead += readBytes;
+                return;
+            } else if (m_toFile) {
+                // the frames are interleaved in place inside the mapping
+                rgb = m_fileSink.reserve(dataEnd);
+                if (rgb == 0) {
+                    setReadStatus(READ_ERROR);
+                    return;
+                }
+                m_outputSize = qMax(m_outputSize, dataEnd);
+            } else {
+                if (m_data->size() < dataEnd) {
+                    // handscanners do not know the size in advance
+                    if (!checkByteArraySize(dataEnd)) {
+                        return;
+                    }
+                    m_data->resize((int)dataEnd);
+                }
+                rgb = reinterpret_cast<uchar *>(m_data->data());
             }
+            PixelOps::mergePlane(rgb, readData, m_frameRead, readBytes, m_params.depth, channel);
+            m_frameRead += readBytes;
             return;
         }
         break;
@@ -289,10 +715,56 @@ void KSaneScanThread::copyToScanData(int readBytes)
     qDebug() << "Format" << m_params.format
              << "and depth" << m_params.format
              << "is not yet suppoeted by libksane!";
-    m_readStatus = READ_ERROR;
+    setReadStatus(READ_ERROR);
     return;
 }
 
+void KSaneScanThread::appendImageData(SANE_Byte *readData, int readBytes)
+{
+    if (m_toFile) {
+        uchar *dest = m_fileSink.reserve(m_outputSize + readBytes);
+        if (dest == 0) {
+            setReadStatus(READ_ERROR);
+            return;
+        }
+        memcpy(dest + m_outputSize, readData, readBytes);
+        m_outputSize += readBytes;
+    } else if (m_segmented) {
+        if (checkByteArraySize(m_segments.size() + readBytes)) {
+            m_segments.append((const char *)readData, readBytes);
+        }
+    } else if (checkByteArraySize((qint64)m_data->size() + readBytes)) {
+        m_data->append((const char *)readData, readBytes);
+    }
+}
+
+bool KSaneScanThread::checkByteArraySize(qint64 size)
+{
+    if (size <= std::numeric_limits<int>::max()) {
+        return true;
+    }
+    qDebug() << "The image needs" << size << "bytes, more than fits in memory. Scan to a file instead.";
+    m_imageTooLarge = true;
+    setReadStatus(READ_ERROR);
+    return false;
+}
+
+void KSaneScanThread::mergeSegmented(SANE_Byte *readData, int readBytes, int channel)
+{
+    // SEGMENT_SIZE / 3 bytes of a frame fill exactly one segment of interleaved data
+    const qint64 planeBytes = SEGMENT_SIZE / 3;
+    qint64 offset = m_frameRead;
+    int done = 0;
+    while (done < readBytes) {
+        qint64 segmentStart = (offset / planeBytes) * planeBytes;
+        int bytes = (int)qMin((qint64)(readBytes - done), segmentStart + planeBytes - offset);
+        uchar *segment = reinterpret_cast<uchar *>(m_segments.segmentAt(segmentStart * 3));
+        PixelOps::mergePlane(segment, readData + done, offset - segmentStart, bytes, m_params.depth, channel);
+        offset += bytes;
+        done   += bytes;
+    }
+}
+
 bool KSaneScanThread::saneStartDone()
 {
     return   m_saneStartDone;
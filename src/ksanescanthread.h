@@ -39,13 +39,30 @@ extern "C"
 #include <QThread>
 #include <QByteArray>
 
-#define SCAN_READ_CHUNK_SIZE 100000
+#include "ksanechunkring.h"
+#include "ksanefilesink.h"
+#include "ksanesegmentedbuffer.h"
+#include "ksaneiowaiter.h"
+#include "ksanereadtuner.h"
+#include "ksanestatsrecorder.h"
+#include "ksaneimageencoder.h"
+#include "ksanedeskewer.h"
+
+#define SCAN_READ_CHUNK_COUNT 16
 
 namespace KSaneIface
 {
+class KSaneReadThread;
+
+/** The final scan is done in two stages: KSaneReadThread only drains sane_read()
+ * into the chunks of a KSaneChunkRing, while run() inverts, interleaves and
+ * appends the data. This way the device is never waiting for the conversion.
+ * Single-pass frames that need no conversion skip the ring and are read
+ * directly into the image buffer. */
 class KSaneScanThread: public QThread
 {
     Q_OBJECT
+    friend class KSaneReadThread;
 public:
     typedef enum {
         READ_ON_GOING,
@@ -54,9 +71,27 @@ public:
         READ_READY
     } ReadStatus;
 
-    KSaneScanThread(SANE_Handle handle, QByteArray *data);
+    KSaneScanThread(SANE_Handle handle, QByteArray *data, KSaneReadTuner *readTuner,
+                    KSaneStatsRecorder *stats);
+    ~KSaneScanThread();
     void run();
     void setImageInverted(bool);
+    void setProgressive(bool);
+    /** Write the image into a memory mapped file instead of the QByteArray.
+     * @param enable turns the file output on or off.
+     * @param fileName is the file to write or empty for a temporary file. */
+    void setOutputFile(bool enable, const QString &fileName);
+    /** @return the file the last image was written to or an empty string. */
+    QString outputFileName();
+    /** @return the number of image bytes written to the output file. */
+    qint64 outputSize();
+    /** Hand the complete lines of the next images also to @p encoder.
+     * @param encoder is the encoder to use or 0 to stop encoding. */
+    void setEncoder(KSaneImageEncoder *encoder);
+    /** Rotate the next images back by @p angle degrees while they are read.
+     * Small angles, 1 bit images, hand scanners and file output are not rotated.
+     * @param angle is the skew of the content, positive is clockwise. */
+    void setDeskewAngle(qreal angle);
     void cancelScan();
     int scanProgress();
     bool saneStartDone();
@@ -64,22 +99,73 @@ public:
     ReadStatus frameStatus();
     SANE_Status saneStatus();
     SANE_Parameters saneParameters();
+    SANE_Parameters imageParameters();
+    int stripLines();
+
+Q_SIGNALS:
+    /** Emitted once the parameters of the first frame are known. */
+    void imageStarted();
+    /** Emitted in progressive mode every time complete lines are available.
+     * For three-pass scans the lines are complete only while reading the last frame. */
+    void imageStripReady(const QByteArray &data, int firstLine, int lines);
 
 private:
-    void readData();
-    void copyToScanData(int readBytes);
+    /** @return true if the data can be read straight into the image buffer. */
+    bool directReadPossible();
+    void readDirect();
+    void convertChunks();
+    void readLoop();
+    /** @return false when the reading is over. */
+    bool readData(KSaneChunkRing::Chunk *chunk);
+    void pushChunk(KSaneChunkRing::Chunk *chunk, int readBytes);
+    void copyToScanData(SANE_Byte *readData, int readBytes);
+    void emitCompletedStrips();
+    ReadStatus readStatus() const;
+    /** Leave READ_ON_GOING. Only the first of the reader, the converter and
+     * cancelScan() sets the final status.
+     * @return false if the status was already set. */
+    bool setReadStatus(ReadStatus status);
+    void handOutStrip(const QByteArray &strip, int firstLine, int lines);
+    void appendImageData(SANE_Byte *readData, int readBytes);
+    /** Stop the scan with an error if a QByteArray can not hold @p size bytes.
+     * @return false if the scan was stopped. */
+    bool checkByteArraySize(qint64 size);
+    void mergeSegmented(SANE_Byte *readData, int readBytes, int channel);
 
-    SANE_Byte       m_readData[SCAN_READ_CHUNK_SIZE];
+    KSaneChunkRing  m_ring;
+    KSaneReadThread *m_readThread;
+    QAtomicInt      m_readDone;
     QByteArray     *m_data;
+    KSaneFileSink   m_fileSink;
+    KSaneSegmentedBuffer m_segments;    ///< image data of hand scanners
+    KSaneIoWaiter   m_ioWaiter;
+    QString         m_outputFileName;
+    qint64          m_outputSize;
     SANE_Handle     m_saneHandle;
-    SANE_Parameters m_params;
-    int             m_frameSize;
-    int             m_frameRead;
+    KSaneReadTuner *m_readTuner;
+    KSaneStatsRecorder *m_stats;
+    KSaneImageEncoder *m_encoder;
+    KSaneDeskewer   m_deskewer;
+    QByteArray      m_deskewed;     ///< the rotated image when it is not progressive
+    qreal           m_deskewAngle;
+    SANE_Parameters m_params;       ///< parameters of the frame being converted
+    SANE_Parameters m_readParams;   ///< parameters of the frame being read
+    SANE_Parameters m_imageParams;
+    qint64          m_frameSize;
+    qint64          m_frameRead;
     int             m_frame_t_count;
-    int             m_dataSize;
+    qint64          m_readFrameRead;
+    int             m_readFrame;
+    qint64          m_dataSize;
     SANE_Status     m_saneStatus;
-    ReadStatus      m_readStatus;
+    QAtomicInt      m_readStatus;   ///< a ReadStatus, shared by all threads
+    int             m_stripLines;
     bool            m_invertColors;
+    bool            m_progressive;
+    bool            m_toFile;
+    bool            m_segmented;
+    bool            m_deskewing;
+    bool            m_imageTooLarge;
     bool            m_saneStartDone;
 };
 }
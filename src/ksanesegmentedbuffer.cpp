@@ -0,0 +1,112 @@
+/* ============================================================
+*
+* This file is part of the KDE project
+*
+* Date        : 2026-10-17
+* Description : Sane interface for KDE
+*
+* Copyright (C) 2026 by the KSane developers
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) version 3, or any
+* later version accepted by the membership of KDE e.V. (or its
+* successor approved by the membership of KDE e.V.), which shall
+* act as a proxy defined in Section 6 of version 3 of the license.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+* ============================================================ */
+
+#include "ksanesegmentedbuffer.h"
+
+#include <string.h>
+
+namespace KSaneIface
+{
+
+KSaneSegmentedBuffer::KSaneSegmentedBuffer():
+    m_size(0)
+{}
+
+void KSaneSegmentedBuffer::clear()
+{
+    m_segments.clear();
+    m_size = 0;
+}
+
+qint64 KSaneSegmentedBuffer::size() const
+{
+    return m_size;
+}
+
+qint64 KSaneSegmentedBuffer::memoryUsage() const
+{
+    return (qint64)m_segments.size() * SEGMENT_SIZE;
+}
+
+void KSaneSegmentedBuffer::append(const char *data, int size)
+{
+    while (size > 0) {
+        int index  = (int)(m_size / SEGMENT_SIZE);
+        int offset = (int)(m_size % SEGMENT_SIZE);
+        if (index == m_segments.size()) {
+            m_segments.append(QByteArray(SEGMENT_SIZE, 0));
+        }
+        int bytes = qMin(size, SEGMENT_SIZE - offset);
+        memcpy(m_segments[index].data() + offset, data, bytes);
+        data   += bytes;
+        size   -= bytes;
+        m_size += bytes;
+    }
+}
+
+void KSaneSegmentedBuffer::resize(qint64 size)
+{
+    while ((qint64)m_segments.size() * SEGMENT_SIZE < size) {
+        m_segments.append(QByteArray(SEGMENT_SIZE, 0));
+    }
+    m_size = qMax(m_size, size);
+}
+
+char *KSaneSegmentedBuffer::segmentAt(qint64 pos)
+{
+    return m_segments[(int)(pos / SEGMENT_SIZE)].data();
+}
+
+QByteArray KSaneSegmentedBuffer::mid(qint64 pos, int size) const
+{
+    QByteArray data;
+    data.reserve(size);
+    while (size > 0) {
+        int offset = (int)(pos % SEGMENT_SIZE);
+        int bytes  = qMin(size, SEGMENT_SIZE - offset);
+        data.append(m_segments.at((int)(pos / SEGMENT_SIZE)).constData() + offset, bytes);
+        pos  += bytes;
+        size -= bytes;
+    }
+    return data;
+}
+
+void KSaneSegmentedBuffer::moveTo(QByteArray *data)
+{
+    data->clear();
+    data->reserve((int)m_size);
+    qint64 left = m_size;
+    while (!m_segments.isEmpty()) {
+        int bytes = (int)qMin(left, (qint64)SEGMENT_SIZE);
+        data->append(m_segments.first().constData(), bytes);
+        m_segments.removeFirst();
+        left -= bytes;
+    }
+    m_size = 0;
+}
+
+}  // NameSpace KSaneIface
@@ -0,0 +1,74 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+#ifndef KSANE_SEGMENTED_BUFFER_H
+#define KSANE_SEGMENTED_BUFFER_H
+
+#include <QByteArray>
+#include <QList>
+
+// a multiple of 6, so a 16 bit RGB pixel never crosses two segments
+#define SEGMENT_SIZE (6 * 512 * 1024)
+
+namespace KSaneIface
+{
+
+/** Image storage for scans of unknown length (hand scanners). The data is
+ * kept in fixed size segments, so growing the buffer never moves the data
+ * that has already been received. */
+class KSaneSegmentedBuffer
+{
+public:
+    KSaneSegmentedBuffer();
+
+    void clear();
+    qint64 size() const;
+    qint64 memoryUsage() const;
+
+    void append(const char *data, int size);
+
+    /** Grow the buffer to at least @p size bytes. The new bytes are zero. */
+    void resize(qint64 size);
+
+    /** @return the start of the segment that contains byte @p pos. */
+    char *segmentAt(qint64 pos);
+
+    /** Copy @p size bytes starting at @p pos into one array. */
+    QByteArray mid(qint64 pos, int size) const;
+
+    /** Move the data into @p data. The segments are released while copying,
+     * so only one extra segment is needed on top of the image. */
+    void moveTo(QByteArray *data);
+
+private:
+    QList<QByteArray> m_segments;
+    qint64            m_size;
+};
+
+}
+
+#endif
@@ -0,0 +1,919 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#include "ksaneselectiondetector.h"
+
+#include "ksaneedgemap.h"
+#include "ksanepixelops.h"
+
+#include <QAtomicInt>
+#include <QVector>
+#include <QPoint>
+#include <QtMath>
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+
+namespace KSaneIface
+{
+
+class KSaneSelectionDetectorPrivate
+{
+public:
+    float area;
+    KSaneSelectionDetector::Method method;
+
+    QList<KSaneSelectionDetector::Object> detect(const QImage &image, const QAtomicInt *cancel) const;
+};
+
+// The change trigger before adding to the sum
+static const int DIFF_TRIGGER = 8;
+
+// The selection start/stop level trigger
+static const int SUM_TRIGGER = 4;
+
+// The selection start/stop level trigger for the floating  average
+static const int AVERAGE_TRIGGER = 7;
+
+// The selection start/stop margin
+static const int SEL_MARGIN = 3;
+
+// Maximum number of allowed selections (this could be a settable variable)
+static const int MAX_NUM_SELECTIONS = 8;
+
+// floating average 'div' must be one less than 'count'
+static const int AVERAGE_COUNT = 50;
+static const int AVERAGE_MULT = 49;
+
+// Minimum selection area compared to the whole image
+static const float MIN_AREA_SIZE = 0.01;
+// ------------------------------------------------------------------------
+// fromRow is the row to start the iterations from. fromRow can be grater than toRow.
+// colStart is the x1 coordinate of the row
+// all parameters are corrected to be valid pixel indexes,
+// but start must be < end
+static int refineRow(KSaneEdgeMap &edges, int fromRow, int toRow, int colStart, int colEnd)
+{
+    int diff;
+    float rowTrigger;
+    int row;
+    int addSub = (fromRow < toRow) ? 1 : -1;
+
+    colStart -= 2; //add some margin
+    colEnd += 2; //add some margin
+
+    if (colStart < 1) {
+        colStart = 1;
+    }
+    if (colEnd >= edges.width() - 1) {
+        colEnd = edges.width() - 2;
+    }
+
+    if (fromRow < 1) {
+        fromRow = 1;
+    }
+    if (fromRow >= edges.height() - 1) {
+        fromRow = edges.height() - 2;
+    }
+
+    if (toRow < 1) {
+        toRow = 1;
+    }
+    if (toRow >= edges.height() - 1) {
+        toRow = edges.height() - 2;
+    }
+
+    row = fromRow;
+    while (row != toRow) {
+        rowTrigger = 0;
+        const quint16 *rowEdges = edges.line(row);
+        for (int w = colStart; w < colEnd; w++) {
+            // how much does the pixel differ from the surrounding
+            diff = rowEdges[w];
+
+            rowTrigger = ((rowTrigger * AVERAGE_MULT) + diff) / AVERAGE_COUNT;
+
+            if (rowTrigger > AVERAGE_TRIGGER) {
+                break;
+            }
+        }
+
+        if (rowTrigger > AVERAGE_TRIGGER) {
+            // row == 1 _probably_ means that the selection should start from 0
+            // but that can not be detected if we start from 1 => include one extra column
+            if (row == 1) {
+                row = 0;
+            }
+            if (row == (edges.width() - 2)) {
+                row = edges.width();
+            }
+            return row;
+        }
+        row += addSub;
+    }
+    return row;
+}
+
+static int refineColumn(KSaneEdgeMap &edges, int fromCol, int toCol, int rowStart, int rowEnd)
+{
+    int diff;
+    float colTrigger;
+    int col;
+    int count;
+    int addSub = (fromCol < toCol) ? 1 : -1;
+
+    rowStart -= 2; //add some margin
+    rowEnd += 2; //add some margin
+
+    if (rowStart < 1) {
+        rowStart = 1;
+    }
+    if (rowEnd >= edges.height() - 1) {
+        rowEnd = edges.height() - 2;
+    }
+
+    if (fromCol < 1) {
+        fromCol = 1;
+    }
+    if (fromCol >= edges.width() - 1) {
+        fromCol = edges.width() - 2;
+    }
+
+    if (toCol < 1) {
+        toCol = 1;
+    }
+    if (toCol >= edges.width() - 1) {
+        toCol = edges.width() - 2;
+    }
+
+    col = fromCol;
+    while (col != toCol) {
+        colTrigger = 0;
+        count = 0;
+        for (int row = rowStart; row < rowEnd; row++) {
+            count++;
+            // how much does the pixel differ from the surrounding
+            diff = edges.line(row)[col];
+
+            colTrigger = ((colTrigger * AVERAGE_MULT) + diff) / AVERAGE_COUNT;
+
+            if (colTrigger > AVERAGE_TRIGGER) {
+                break;
+            }
+        }
+
+        if (colTrigger > AVERAGE_TRIGGER) {
+            // col == 1 _probably_ means that the selection should start from 0
+            // but that can not be detected if we start from 1 => include one extra column
+            if (col == 1) {
+                col = 0;
+            }
+            if (col == (edges.width() - 2)) {
+                col = edges.width();
+            }
+            return col;
+        }
+        col += addSub;
+    }
+    return col;
+}
+
+static void refineSelections(const QImage &image, QList<QRectF> &selections, int pixelMargin)
+{
+    // The end result
+    int hSelStart;
+    int hSelEnd;
+    int wSelStart;
+    int wSelEnd;
+
+    if (selections.isEmpty()) {
+        return;
+    }
+    KSaneEdgeMap edges(image, DIFF_TRIGGER);
+
+    for (int i = 0; i < selections.size(); i++) {
+        QRectF selRect = selections.at(i);
+
+        // original values
+        hSelStart = (int)selRect.top();
+        hSelEnd = (int)selRect.bottom();
+        wSelStart = (int)selRect.left();
+        wSelEnd = (int)selRect.right();
+
+        // Top
+        // Too long iteration should not be a problem since the loop should be interrupted by the limit
+        hSelStart = refineRow(edges, hSelStart - pixelMargin, hSelEnd, wSelStart, wSelEnd);
+
+        // Bottom (from the bottom up wards)
+        hSelEnd = refineRow(edges, hSelEnd + pixelMargin, hSelStart, wSelStart, wSelEnd);
+
+        // Left
+        wSelStart = refineColumn(edges, wSelStart - pixelMargin, wSelEnd, hSelStart, hSelEnd);
+
+        // Right
+        wSelEnd = refineColumn(edges, wSelEnd + pixelMargin, wSelStart, hSelStart, hSelEnd);
+
+        // Now update the selection
+        selections[i] = QRectF(QPointF(wSelStart, hSelStart), QPointF(wSelEnd, hSelEnd)).normalized();
+    }
+}
+
+// ------------------------------------------------------------------------
+/** Find the selections in @p image. This only works on its arguments, so it can
+ * run on any thread. @return an empty list if @p cancel is set while searching. */
+static QList<QRectF> detectSelections(const QImage &image, float area, const QAtomicInt *cancel)
+{
+    QList<QRectF> selections;
+    if ((image.width() < 3) || (image.height() < 3)) {
+        return selections;
+    }
+
+    // Reduce the size of the image to decrease noise and calculation time
+    float multiplier = sqrt(area / (image.height() * image.width()));
+
+    int width  = (int)(image.width() * multiplier);
+    int height = (int)(image.height() * multiplier);
+
+    QImage img = image.scaled(width, height, Qt::KeepAspectRatio);
+    height = img.height(); // the size was probably not exact
+    width  = img.width();
+
+    if (width < 2) {
+        // the edges need a left or right neighbour
+        return selections;
+    }
+
+    QVector<qint64> colSums(width + SEL_MARGIN + 1);
+    qint64 rowSum;
+    colSums.fill(0);
+    int hSelStart = -1;
+    int hSelEnd = -1;
+    int hSelMargin = 0;
+    int wSelStart = -1;
+    int wSelEnd = -1;
+    int wSelMargin = 0;
+
+    KSaneEdgeMap edges(img, DIFF_TRIGGER);
+    for (int h = 1; h < height; h++) {
+        if (cancel && cancel->loadAcquire()) {
+            return QList<QRectF>();
+        }
+        rowSum = 0;
+        if (h < height - 1) {
+            // how much do the pixels differ from the surrounding
+            rowSum = PixelOps::addColumnSums(colSums.data(), edges.line(h), width);
+        }
+
+        if ((rowSum / width) > SUM_TRIGGER) {
+            if (hSelStart < 0) {
+                if (hSelMargin < SEL_MARGIN) {
+                    hSelMargin++;
+                }
+                if (hSelMargin == SEL_MARGIN) {
+                    hSelStart = h - SEL_MARGIN + 1;
+                }
+            }
+        } else {
+            if (hSelStart >= 0) {
+                if (hSelMargin > 0) {
+                    hSelMargin--;
+                }
+            }
+            if ((hSelStart > -1) && ((hSelMargin == 0) || (h == height - 1))) {
+                if (h == height - 1) {
+                    hSelEnd = h - hSelMargin;
+                } else {
+                    hSelEnd = h - SEL_MARGIN;
+                }
+                // We have the end of the vertical selection
+                // now figure out the horizontal part of the selection
+                for (int w = 0; w <= width; w++) { // colSums[width] will be 0
+                    if ((colSums[w] / (h - hSelStart)) > SUM_TRIGGER) {
+                        if (wSelStart < 0) {
+                            if (wSelMargin < SEL_MARGIN) {
+                                wSelMargin++;
+                            }
+                            if (wSelMargin == SEL_MARGIN) {
+                                wSelStart = w - SEL_MARGIN + 1;
+                            }
+                        }
+                    } else {
+                        if (wSelStart >= 0) {
+                            if (wSelMargin > 0) {
+                                wSelMargin--;
+                            }
+                        }
+                        if ((wSelStart >= 0) && ((wSelMargin == 0) || (w == width))) {
+                            if (w == width) {
+                                wSelEnd = width;
+                            } else {
+                                wSelEnd = w - SEL_MARGIN + 1;
+                            }
+
+                            // we have the end of a horizontal selection
+                            if ((wSelEnd - wSelStart) < width) {
+                                // skip selections that span the whole width
+                                // calculate the coordinates in the original size
+                                int x1 = wSelStart / multiplier;
+                                int y1 = hSelStart / multiplier;
+                                int x2 = wSelEnd / multiplier;
+                                int y2 = hSelEnd / multiplier;
+                                float selArea = (float)(wSelEnd - wSelStart) * (float)(hSelEnd - hSelStart);
+                                if (selArea > (area * MIN_AREA_SIZE)) {
+                                    selections.append(QRectF(QRect(QPoint(x1, y1), QPoint(x2, y2))).normalized());
+                                }
+                            }
+                            wSelStart = -1;
+                            wSelEnd = -1;
+                            wSelMargin = 0;
+                        }
+                    }
+                }
+                hSelStart = -1;
+                hSelEnd = -1;
+                hSelMargin = 0;
+                colSums.fill(0);
+            }
+        }
+    }
+
+    if (selections.size() > MAX_NUM_SELECTIONS) {
+        // smaller area or should we give up??
+        //findSelections(area/2);
+        // instead of trying to find probably broken selections just give up
+        // and do not force broken selections on the user.
+        return QList<QRectF>();
+    }
+
+    // 1/multiplier is the error margin caused by the resolution reduction
+    refineSelections(image, selections, qRound(1 / multiplier));
+    // check that the selections are big enough
+    float minArea = image.height() * image.width() * MIN_AREA_SIZE;
+
+    int i = 0;
+    while (i < selections.size()) {
+        if ((selections[i].width() * selections[i].height()) < minArea) {
+            selections.removeAt(i);
+        } else {
+            i++;
+        }
+    }
+    if (cancel && cancel->loadAcquire()) {
+        return QList<QRectF>();
+    }
+    return selections;
+}
+
+// ------------------------------------------------------------------------
+// Connected components
+
+// Edges this many pixels apart (in the reduced image) belong to the same object
+static const int COMPONENT_GAP = 1;
+
+// The biggest objects that are kept
+static const int MAX_NUM_OBJECTS = 32;
+
+// A component this big in both directions is the scanner lid or bed, not an object
+static const float MAX_OBJECT_SIZE = 0.95;
+
+struct Component {
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+    int pixels;
+    int label;
+    int width() const {
+        return maxX - minX + 1;
+    }
+    int height() const {
+        return maxY - minY + 1;
+    }
+    bool contains(const Component &other) const {
+        return (other.minX >= minX) && (other.maxX <= maxX) && (other.minY >= minY) && (other.maxY <= maxY);
+    }
+};
+
+static bool largerComponent(const Component &a, const Component &b)
+{
+    return (qint64)a.width() * a.height() > (qint64)b.width() * b.height();
+}
+
+static bool componentBefore(const Component &a, const Component &b)
+{
+    return (a.minY < b.minY) || ((a.minY == b.minY) && (a.minX < b.minX));
+}
+
+/** Union-find with path halving. */
+static int findRoot(QVector<int> &parent, int label)
+{
+    while (parent[label] != label) {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+    return label;
+}
+
+static int unite(QVector<int> &parent, int a, int b)
+{
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a < b) {
+        parent[b] = a;
+        return a;
+    }
+    parent[a] = b;
+    return b;
+}
+
+static qint64 cross(const QPoint &o, const QPoint &a, const QPoint &b)
+{
+    return (qint64)(a.x() - o.x()) * (b.y() - o.y()) - (qint64)(a.y() - o.y()) * (b.x() - o.x());
+}
+
+static bool pointBefore(const QPoint &a, const QPoint &b)
+{
+    return (a.x() < b.x()) || ((a.x() == b.x()) && (a.y() < b.y()));
+}
+
+/** The rotation of the smallest rectangle around @p points in degrees.
+ * The points are the leftmost and rightmost pixel of each line of an object. */
+static qreal rotationAngle(QVector<QPoint> points)
+{
+    // convex hull with the monotone chain algorithm
+    std::sort(points.begin(), points.end(), pointBefore);
+    QVector<QPoint> hull(2 * points.size());
+    int k = 0;
+    for (int i = 0; i < points.size(); i++) {
+        while ((k >= 2) && (cross(hull[k - 2], hull[k - 1], points[i]) <= 0)) {
+            k--;
+        }
+        hull[k++] = points[i];
+    }
+    for (int i = points.size() - 2, lower = k + 1; i >= 0; i--) {
+        while ((k >= lower) && (cross(hull[k - 2], hull[k - 1], points[i]) <= 0)) {
+            k--;
+        }
+        hull[k++] = points[i];
+    }
+    hull.resize(qMax(k - 1, 0));
+    if (hull.size() < 3) {
+        return 0;
+    }
+
+    // one side of the smallest enclosing rectangle is on a side of the hull
+    qreal bestArea = std::numeric_limits<qreal>::max();
+    qreal bestAngle = 0;
+    for (int i = 0; i < hull.size(); i++) {
+        const QPoint &a = hull[i];
+        const QPoint &b = hull[(i + 1) % hull.size()];
+        qreal angle = atan2((qreal)(b.y() - a.y()), (qreal)(b.x() - a.x()));
+        qreal ux = cos(angle);
+        qreal uy = sin(angle);
+        qreal minU = std::numeric_limits<qreal>::max();
+        qreal maxU = -minU;
+        qreal minV = minU;
+        qreal maxV = -minU;
+        for (int j = 0; j < hull.size(); j++) {
+            qreal u = hull[j].x() * ux + hull[j].y() * uy;
+            qreal v = hull[j].y() * ux - hull[j].x() * uy;
+            minU = qMin(minU, u);
+            maxU = qMax(maxU, u);
+            minV = qMin(minV, v);
+            maxV = qMax(maxV, v);
+        }
+        qreal rectArea = (maxU - minU) * (maxV - minV);
+        if (rectArea < bestArea) {
+            bestArea = rectArea;
+            bestAngle = angle;
+        }
+    }
+
+    qreal degrees = qRadiansToDegrees(bestAngle);
+    while (degrees > 45.0) {
+        degrees -= 90.0;
+    }
+    while (degrees <= -45.0) {
+        degrees += 90.0;
+    }
+    return degrees;
+}
+
+/** Find the objects in @p image as connected components of the edge map.
+ * @return the objects in pixel coordinates or an empty list if @p cancel is set. */
+static QList<KSaneSelectionDetector::Object> detectComponents(const QImage &image, float area, const QAtomicInt *cancel)
+{
+    QList<KSaneSelectionDetector::Object> objects;
+    if ((image.width() < 3) || (image.height() < 3)) {
+        return objects;
+    }
+
+    // Reduce the size of the image to decrease noise and calculation time
+    float multiplier = sqrt(area / (image.height() * image.width()));
+    QImage img = image.scaled((int)(image.width() * multiplier), (int)(image.height() * multiplier),
+                              Qt::KeepAspectRatio);
+    const int width  = img.width();
+    const int height = img.height();
+    if ((width < 3) || (height < 3)) {
+        return objects;
+    }
+
+    // binary edge mask, grown by COMPONENT_GAP to close small breaks in the outlines
+    KSaneEdgeMap edges(img, DIFF_TRIGGER);
+    QVector<uchar> mask(width * height, 0);
+    for (int y = 1; y < height - 1; y++) {
+        const quint16 *line = edges.line(y);
+        for (int x = 0; x < width; x++) {
+            if (line[x] == 0) {
+                continue;
+            }
+            for (int my = qMax(y - COMPONENT_GAP, 0); my <= qMin(y + COMPONENT_GAP, height - 1); my++) {
+                uchar *row = mask.data() + my * width;
+                memset(row + qMax(x - COMPONENT_GAP, 0), 1,
+                       qMin(x + COMPONENT_GAP, width - 1) - qMax(x - COMPONENT_GAP, 0) + 1);
+            }
+        }
+    }
+    if (cancel && cancel->loadAcquire()) {
+        return QList<KSaneSelectionDetector::Object>();
+    }
+
+    // first pass: provisional labels from the 8-connected neighbours above and to the left
+    QVector<int> labels(width * height, -1);
+    QVector<int> parent;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const int i = y * width + x;
+            if (!mask[i]) {
+                continue;
+            }
+            int label = -1;
+            const int neighbours[4] = {
+                (x > 0) ? labels[i - 1] : -1,
+                ((x > 0) && (y > 0)) ? labels[i - width - 1] : -1,
+                (y > 0) ? labels[i - width] : -1,
+                ((x < width - 1) && (y > 0)) ? labels[i - width + 1] : -1
+            };
+            for (int n = 0; n < 4; n++) {
+                if (neighbours[n] < 0) {
+                    continue;
+                }
+                label = (label < 0) ? neighbours[n] : unite(parent, label, neighbours[n]);
+            }
+            if (label < 0) {
+                label = parent.size();
+                parent.append(label);
+            }
+            labels[i] = label;
+        }
+    }
+
+    // second pass: resolve the labels and collect the bounding boxes
+    QVector<Component> components(parent.size());
+    for (int c = 0; c < components.size(); c++) {
+        Component &comp = components[c];
+        comp.minX = width;
+        comp.minY = height;
+        comp.maxX = -1;
+        comp.maxY = -1;
+        comp.pixels = 0;
+        comp.label = c;
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int &label = labels[y * width + x];
+            if (label < 0) {
+                continue;
+            }
+            label = findRoot(parent, label);
+            Component &comp = components[label];
+            comp.minX = qMin(comp.minX, x);
+            comp.maxX = qMax(comp.maxX, x);
+            comp.minY = qMin(comp.minY, y);
+            comp.maxY = qMax(comp.maxY, y);
+            comp.pixels++;
+        }
+    }
+
+    // keep the components that are big enough, but not the whole bed
+    QList<Component> candidates;
+    for (int c = 0; c < components.size(); c++) {
+        const Component &comp = components[c];
+        if (comp.pixels == 0) {
+            continue;
+        }
+        if ((float)comp.width() * comp.height() <= area * MIN_AREA_SIZE) {
+            continue;
+        }
+        if ((comp.width() >= width * MAX_OBJECT_SIZE) && (comp.height() >= height * MAX_OBJECT_SIZE)) {
+            continue;
+        }
+        candidates.append(comp);
+    }
+    std::sort(candidates.begin(), candidates.end(), largerComponent);
+
+    // drop the details inside an object, e.g. the edges of a picture inside a photo
+    QList<Component> kept;
+    for (int i = 0; (i < candidates.size()) && (kept.size() < MAX_NUM_OBJECTS); i++) {
+        bool inside = false;
+        for (int k = 0; k < kept.size(); k++) {
+            if (kept[k].contains(candidates[i])) {
+                inside = true;
+                break;
+            }
+        }
+        if (!inside) {
+            kept.append(candidates[i]);
+        }
+    }
+    std::sort(kept.begin(), kept.end(), componentBefore);
+    if (cancel && cancel->loadAcquire()) {
+        return QList<KSaneSelectionDetector::Object>();
+    }
+
+    // the outline of each object: the leftmost and rightmost pixel of every line
+    QVector<int> keptIndex(components.size(), -1);
+    QVector<QVector<int> > rowMin(kept.size());
+    QVector<QVector<int> > rowMax(kept.size());
+    for (int k = 0; k < kept.size(); k++) {
+        keptIndex[kept[k].label] = k;
+        rowMin[k].fill(width, kept[k].height());
+        rowMax[k].fill(-1, kept[k].height());
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int label = labels[y * width + x];
+            if ((label < 0) || (keptIndex[label] < 0)) {
+                continue;
+            }
+            int k = keptIndex[label];
+            int row = y - kept[k].minY;
+            rowMin[k][row] = qMin(rowMin[k][row], x);
+            rowMax[k][row] = qMax(rowMax[k][row], x);
+        }
+    }
+
+    for (int k = 0; k < kept.size(); k++) {
+        const Component &comp = kept[k];
+        QVector<QPoint> points;
+        for (int row = 0; row < comp.height(); row++) {
+            if (rowMax[k][row] >= 0) {
+                points.append(QPoint(rowMin[k][row], comp.minY + row));
+                points.append(QPoint(rowMax[k][row], comp.minY + row));
+            }
+        }
+
+        // the mask is grown by COMPONENT_GAP on every side
+        int x1 = qBound(0, (int)((comp.minX + COMPONENT_GAP) / multiplier), image.width());
+        int y1 = qBound(0, (int)((comp.minY + COMPONENT_GAP) / multiplier), image.height());
+        int x2 = qBound(0, (int)((comp.maxX + 1 - COMPONENT_GAP) / multiplier), image.width());
+        int y2 = qBound(0, (int)((comp.maxY + 1 - COMPONENT_GAP) / multiplier), image.height());
+
+        KSaneSelectionDetector::Object object;
+        object.rect  = QRectF(QPointF(x1, y1), QPointF(x2, y2)).normalized();
+        object.angle = rotationAngle(points);
+        objects.append(object);
+    }
+    return objects;
+}
+
+// ------------------------------------------------------------------------
+// Skew estimation
+
+// The number of pixels of the reduced image the skew is estimated on
+static const float SKEW_AREA = 200000.0;
+
+// Only strong edges are used for the projection profiles
+static const int SKEW_EDGE_TRIGGER = 40;
+
+// The largest skew that is searched for and the steps of the search in degrees
+static const qreal MAX_SKEW = 10.0;
+static const qreal SKEW_COARSE_STEP = 0.5;
+static const qreal SKEW_FINE_STEP = 0.05;
+
+// Fewer edge points than this are not enough to tell a skew
+static const int MIN_SKEW_POINTS = 200;
+
+// How much sharper than the profile of the unturned image the best profile
+// must be to be trusted; noise and photos have no sharp profile at any angle
+static const qreal MIN_SKEW_GAIN = 0.05;
+
+/** The sharpness of the horizontal projection profile of @p points when the
+ * image is turned back by @p degrees: the sum of the squared line counts. */
+static qint64 profileScore(const QVector<QPoint> &points, qreal degrees, int width, int height,
+                           QVector<int> &bins)
+{
+    const qreal angle = qDegreesToRadians(degrees);
+    const qreal c = cos(angle);
+    const qreal s = sin(angle);
+    // the lowest line index is -width * |sin|
+    const int offset = (int)(width * qAbs(s)) + 1;
+    bins.fill(0, height + 2 * offset + 2);
+    for (int i = 0; i < points.size(); i++) {
+        int line = qRound(points[i].y() * c - points[i].x() * s) + offset;
+        bins[line]++;
+    }
+    qint64 score = 0;
+    for (int i = 0; i < bins.size(); i++) {
+        score += (qint64)bins[i] * bins[i];
+    }
+    return score;
+}
+
+/** Find the best angle from @p from to @p to in steps of @p step.
+ * @p bestScore is set to the profile score of that angle. */
+static qreal bestSkew(const QVector<QPoint> &points, qreal from, qreal to, qreal step, int width, int height,
+                      qint64 &bestScore, const QAtomicInt *cancel)
+{
+    QVector<int> bins;
+    qreal best = 0;
+    bestScore = -1;
+    const int steps = qRound((to - from) / step);
+    for (int i = 0; i <= steps; i++) {
+        if (cancel && cancel->loadAcquire()) {
+            return 0;
+        }
+        qreal degrees = from + i * step;
+        qint64 score = profileScore(points, degrees, width, height, bins);
+        // prefer the smaller angle when the scores are equal
+        if ((score > bestScore) || ((score == bestScore) && (qAbs(degrees) < qAbs(best)))) {
+            bestScore = score;
+            best = degrees;
+        }
+    }
+    return best;
+}
+
+static qreal estimateImageSkew(const QImage &image, const QAtomicInt *cancel)
+{
+    if ((image.width() < 3) || (image.height() < 3)) {
+        return 0;
+    }
+    QImage img = image;
+    float multiplier = sqrt(SKEW_AREA / (image.height() * image.width()));
+    if (multiplier < 1.0) {
+        img = image.scaled((int)(image.width() * multiplier), (int)(image.height() * multiplier),
+                           Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    const int width  = img.width();
+    const int height = img.height();
+    if ((width < 3) || (height < 3)) {
+        return 0;
+    }
+
+    KSaneEdgeMap edges(img, SKEW_EDGE_TRIGGER);
+    QVector<QPoint> points;
+    for (int y = 1; y < height - 1; y++) {
+        const quint16 *line = edges.line(y);
+        for (int x = 1; x < width - 1; x++) {
+            if (line[x] != 0) {
+                points.append(QPoint(x, y));
+            }
+        }
+    }
+    if (points.size() < MIN_SKEW_POINTS) {
+        return 0;
+    }
+
+    qint64 score;
+    qreal coarse = bestSkew(points, -MAX_SKEW, MAX_SKEW, SKEW_COARSE_STEP, width, height, score, cancel);
+    qreal fine = bestSkew(points, coarse - SKEW_COARSE_STEP, coarse + SKEW_COARSE_STEP, SKEW_FINE_STEP,
+                          width, height, score, cancel);
+    if (cancel && cancel->loadAcquire()) {
+        return 0;
+    }
+
+    QVector<int> bins;
+    qint64 straightScore = profileScore(points, 0, width, height, bins);
+    if (score < straightScore * (1.0 + MIN_SKEW_GAIN)) {
+        return 0;
+    }
+    return fine;
+}
+
+// ------------------------------------------------------------------------
+QList<KSaneSelectionDetector::Object> KSaneSelectionDetectorPrivate::detect(const QImage &image,
+                                                                            const QAtomicInt *cancel) const
+{
+    if (method == KSaneSelectionDetector::ComponentMethod) {
+        return detectComponents(image, area, cancel);
+    }
+    QList<QRectF> selections = detectSelections(image, area, cancel);
+    QList<KSaneSelectionDetector::Object> objects;
+    for (int i = 0; i < selections.size(); i++) {
+        KSaneSelectionDetector::Object object;
+        object.rect  = selections[i];
+        object.angle = 0;
+        objects.append(object);
+    }
+    return objects;
+}
+
+static QList<QRectF> normalizedSelections(const QList<KSaneSelectionDetector::Object> &objects, int width, int height)
+{
+    QList<QRectF> normalized;
+    for (int i = 0; i < objects.size(); i++) {
+        const QRectF &r = objects[i].rect;
+        normalized.append(QRectF(r.x() / width, r.y() / height, r.width() / width, r.height() / height));
+    }
+    return normalized;
+}
+
+KSaneSelectionDetector::KSaneSelectionDetector() : d(new KSaneSelectionDetectorPrivate)
+{
+    d->area = 10000.0;
+    d->method = ProjectionMethod;
+}
+
+KSaneSelectionDetector::~KSaneSelectionDetector()
+{
+    delete d;
+}
+
+void KSaneSelectionDetector::setReductionArea(float area)
+{
+    d->area = area;
+}
+
+float KSaneSelectionDetector::reductionArea() const
+{
+    return d->area;
+}
+
+void KSaneSelectionDetector::setMethod(Method method)
+{
+    d->method = method;
+}
+
+KSaneSelectionDetector::Method KSaneSelectionDetector::method() const
+{
+    return d->method;
+}
+
+QList<QRectF> KSaneSelectionDetector::detectPixels(const QImage &image, const QAtomicInt *cancel) const
+{
+    QList<Object> objects = d->detect(image, cancel);
+    QList<QRectF> selections;
+    for (int i = 0; i < objects.size(); i++) {
+        selections.append(objects[i].rect);
+    }
+    return selections;
+}
+
+QList<QRectF> KSaneSelectionDetector::detect(const QImage &image, const QAtomicInt *cancel) const
+{
+    return normalizedSelections(d->detect(image, cancel), image.width(), image.height());
+}
+
+QList<QRectF> KSaneSelectionDetector::detect(const uchar *gray, int width, int height, int bytesPerLine,
+                                             const QAtomicInt *cancel) const
+{
+    // the data is only read, the scaled copy is made by the search
+    QImage image(gray, width, height, bytesPerLine, QImage::Format_Grayscale8);
+    return normalizedSelections(d->detect(image, cancel), width, height);
+}
+
+QList<KSaneSelectionDetector::Object> KSaneSelectionDetector::detectObjects(const QImage &image,
+                                                                            const QAtomicInt *cancel) const
+{
+    QList<Object> objects = d->detect(image, cancel);
+    for (int i = 0; i < objects.size(); i++) {
+        QRectF &r = objects[i].rect;
+        r = QRectF(r.x() / image.width(), r.y() / image.height(), r.width() / image.width(), r.height() / image.height());
+    }
+    return objects;
+}
+
+qreal KSaneSelectionDetector::estimateSkew(const QImage &image, const QAtomicInt *cancel) const
+{
+    return estimateImageSkew(image, cancel);
+}
+
+}  // NameSpace KSaneIface
@@ -0,0 +1,131 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#ifndef KSANE_SELECTION_DETECTOR_H
+#define KSANE_SELECTION_DETECTOR_H
+
+#include "ksane_export.h"
+
+#include <QImage>
+#include <QList>
+#include <QRectF>
+
+class QAtomicInt;
+
+namespace KSaneIface
+{
+
+class KSaneSelectionDetectorPrivate;
+
+/**
+ * This class finds the documents or photos on a preview image, the same way
+ * KSaneWidget makes its automatic selections. It does not need a widget.
+ *
+ * The detector only reads its arguments, so one detector can be used from
+ * several threads at the same time, for example to go through many previews
+ * in a QThreadPool.
+ */
+class KSANE_EXPORT KSaneSelectionDetector
+{
+public:
+    /** The ways to find the selections. */
+    typedef enum {
+        ProjectionMethod, /**< Looks for bands of rows and columns with edges (default).
+                           * This needs a clean band between the objects and gives up
+                           * when it finds more than eight. */
+        ComponentMethod   /**< Joins the edges to connected components and returns their
+                           * bounding boxes. This works for dense layouts with many
+                           * objects and also estimates the rotation of each object. */
+    } Method;
+
+    /** An object found on the image. */
+    struct Object {
+        QRectF rect;      /**< The bounding box. */
+        qreal  angle;     /**< The rotation of the object in degrees, in the range -45 -> 45.
+                           * Positive is clockwise on the image. Always 0 for ProjectionMethod. */
+    };
+
+    KSaneSelectionDetector();
+    ~KSaneSelectionDetector();
+
+    /** Select the way the selections are found.
+    * @param method is the method to use. */
+    void setMethod(Method method);
+    Method method() const;
+
+    /** The image is scaled down to about this many pixels before the search,
+    * to decrease noise and calculation time. The default is 10000.
+    * @param area is the number of pixels of the reduced image. */
+    void setReductionArea(float area);
+    float reductionArea() const;
+
+    /** Find the selections in an image.
+    * @param image is the image to search. Any QImage format can be used.
+    * @param cancel stops the search early when it is set to a value other than 0.
+    * @return the selections in the range 0.0 -> 1.0 of the image width and height,
+    * or an empty list if nothing was found or the search was canceled. */
+    QList<QRectF> detect(const QImage &image, const QAtomicInt *cancel = 0) const;
+
+    /** This is an overloaded function.
+    * @param gray is an 8 bit gray image.
+    * @param width is the number of pixels per line.
+    * @param height is the number of lines.
+    * @param bytesPerLine is the distance between the lines in bytes.
+    * @param cancel stops the search early when it is set to a value other than 0. */
+    QList<QRectF> detect(const uchar *gray, int width, int height, int bytesPerLine,
+                         const QAtomicInt *cancel = 0) const;
+
+    /** Find the selections in an image.
+    * @return the selections in pixel coordinates of @p image. */
+    QList<QRectF> detectPixels(const QImage &image, const QAtomicInt *cancel = 0) const;
+
+    /** Find the objects in an image together with their rotation.
+    * @param image is the image to search.
+    * @param cancel stops the search early when it is set to a value other than 0.
+    * @return the objects with rectangles in the range 0.0 -> 1.0 of the image
+    * width and height. */
+    QList<Object> detectObjects(const QImage &image, const QAtomicInt *cancel = 0) const;
+
+    /** Estimate how much the content of an image is rotated, e.g. from the
+    * lines of a text or the edges of a photo. The image is reduced to about
+    * 200000 pixels, so a preview is enough to deskew the final scan.
+    * @param image is the image to check.
+    * @param cancel stops the estimation early when it is set to a value other than 0.
+    * @return the rotation in degrees in the range -10 -> 10, positive is clockwise
+    * on the image. 0 if no rotation was found, the image has too few lines to
+    * be sure of one or the estimation was canceled. */
+    qreal estimateSkew(const QImage &image, const QAtomicInt *cancel = 0) const;
+
+private:
+    Q_DISABLE_COPY(KSaneSelectionDetector)
+    KSaneSelectionDetectorPrivate *const d;
+};
+
+}  // NameSpace KSaneIface
+
+#endif
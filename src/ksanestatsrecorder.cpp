@@ -0,0 +1,153 @@
+/* ============================================================
+*
+* This file is part of the KDE project
+*
+* Date        : 2026-10-17
+* Description : Sane interface for KDE
+*
+* Copyright (C) 2026 by the KSane developers
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) version 3, or any
+* later version accepted by the membership of KDE e.V. (or its
+* successor approved by the membership of KDE e.V.), which shall
+* act as a proxy defined in Section 6 of version 3 of the license.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+* ============================================================ */
+
+#include "ksanestatsrecorder.h"
+
+#include <QMutexLocker>
+
+namespace KSaneIface
+{
+
+static void clearStatistics(KSaneWidget::ScanStatistics &stats)
+{
+    stats.preview        = false;
+    stats.completed      = false;
+    stats.bytes          = 0;
+    stats.startTime      = 0;
+    stats.firstByteTime  = -1;
+    stats.readTime       = 0;
+    stats.convertTime    = 0;
+    stats.emitTime       = 0;
+    stats.stallTime      = 0;
+    stats.totalTime      = 0;
+    stats.peakMemory     = 0;
+    stats.bytesPerSecond = 0.0;
+    stats.readCalls      = 0;
+    stats.readTimeHistogram.fill(0, STATS_HISTOGRAM_BUCKETS);
+}
+
+KSaneStatsRecorder::KSaneStatsRecorder():
+    m_readUsecs(0),
+    m_convertUsecs(0),
+    m_emitUsecs(0),
+    m_stallUsecs(0),
+    m_readMemory(0),
+    m_imageMemory(0)
+{
+    clearStatistics(m_stats);
+}
+
+void KSaneStatsRecorder::start(bool preview)
+{
+    QMutexLocker locker(&m_mutex);
+    clearStatistics(m_stats);
+    m_stats.preview = preview;
+    m_readUsecs     = 0;
+    m_convertUsecs  = 0;
+    m_emitUsecs     = 0;
+    m_stallUsecs    = 0;
+    m_readMemory    = 0;
+    m_imageMemory   = 0;
+    m_timer.start();
+}
+
+void KSaneStatsRecorder::startDone()
+{
+    QMutexLocker locker(&m_mutex);
+    m_stats.startTime = m_timer.elapsed();
+}
+
+void KSaneStatsRecorder::addRead(int bytes, qint64 usecs)
+{
+    QMutexLocker locker(&m_mutex);
+    if ((bytes > 0) && (m_stats.firstByteTime < 0)) {
+        m_stats.firstByteTime = m_timer.elapsed();
+    }
+    m_stats.bytes += bytes;
+    m_stats.readCalls++;
+    m_readUsecs += usecs;
+    m_stats.readTime = m_readUsecs / 1000;
+
+    int bucket = 0;
+    for (qint64 msecs = usecs / 1000; (msecs > 0) && (bucket < STATS_HISTOGRAM_BUCKETS - 1); msecs >>= 1) {
+        bucket++;
+    }
+    m_stats.readTimeHistogram[bucket]++;
+}
+
+void KSaneStatsRecorder::addConvert(qint64 usecs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_convertUsecs += usecs;
+    m_stats.convertTime = m_convertUsecs / 1000;
+}
+
+void KSaneStatsRecorder::addEmit(qint64 usecs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_emitUsecs += usecs;
+    m_stats.emitTime = m_emitUsecs / 1000;
+}
+
+void KSaneStatsRecorder::addStall(qint64 usecs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_stallUsecs += usecs;
+    m_stats.stallTime = m_stallUsecs / 1000;
+}
+
+void KSaneStatsRecorder::setReadMemory(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_readMemory = bytes;
+    m_stats.peakMemory = qMax(m_stats.peakMemory, m_readMemory + m_imageMemory);
+}
+
+void KSaneStatsRecorder::setImageMemory(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_imageMemory = bytes;
+    m_stats.peakMemory = qMax(m_stats.peakMemory, m_readMemory + m_imageMemory);
+}
+
+void KSaneStatsRecorder::finish(bool completed)
+{
+    QMutexLocker locker(&m_mutex);
+    m_stats.completed   = completed;
+    m_stats.totalTime   = m_timer.elapsed();
+    if (m_stats.totalTime > 0) {
+        m_stats.bytesPerSecond = (m_stats.bytes * 1000.0) / m_stats.totalTime;
+    }
+}
+
+KSaneWidget::ScanStatistics KSaneStatsRecorder::statistics()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_stats;
+}
+
+}  // NameSpace KSaneIface
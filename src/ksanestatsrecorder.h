@@ -0,0 +1,79 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+#ifndef KSANE_STATS_RECORDER_H
+#define KSANE_STATS_RECORDER_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+
+#include "ksanewidget.h"
+
+#define STATS_HISTOGRAM_BUCKETS 16
+
+namespace KSaneIface
+{
+
+/** Collects the KSaneWidget::ScanStatistics of one scan. The reader and
+ * the converter threads of a final scan report to the same recorder, so
+ * all updates are serialized with a mutex. */
+class KSaneStatsRecorder
+{
+public:
+    KSaneStatsRecorder();
+
+    /** Clear the figures and start the clock of a new scan. */
+    void start(bool preview);
+    /** sane_start() has returned. */
+    void startDone();
+    void addRead(int bytes, qint64 usecs);
+    void addConvert(qint64 usecs);
+    void addEmit(qint64 usecs);
+    void addStall(qint64 usecs);
+    /** Report the current size of the read buffers and of the image buffer. */
+    void setReadMemory(qint64 bytes);
+    void setImageMemory(qint64 bytes);
+    /** Stop the clock. */
+    void finish(bool completed);
+
+    KSaneWidget::ScanStatistics statistics();
+
+private:
+    QMutex                      m_mutex;
+    QElapsedTimer               m_timer;
+    KSaneWidget::ScanStatistics m_stats;
+    qint64                      m_readUsecs;
+    qint64                      m_convertUsecs;
+    qint64                      m_emitUsecs;
+    qint64                      m_stallUsecs;
+    qint64                      m_readMemory;
+    qint64                      m_imageMemory;
+};
+
+}
+
+#endif
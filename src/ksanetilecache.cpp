@@ -0,0 +1,233 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#include "ksanetilecache.h"
+
+#include <QPainter>
+#include <QRectF>
+
+#include "ksanepixelops.h"
+
+namespace KSaneIface
+{
+
+KSaneTileCache::KSaneTileCache():
+    m_img(0),
+    m_imgBits(0)
+{
+}
+
+void KSaneTileCache::setImage(const QImage *img)
+{
+    m_img = img;
+    m_imgBits = img ? img->constBits() : 0;
+    m_imgSize = img ? img->size() : QSize();
+    buildLevels();
+}
+
+void KSaneTileCache::buildLevels()
+{
+    m_levels.clear();
+    if (!m_img || m_img->isNull() || (m_img->depth() != 32)) {
+        // only 32 bit images are scaled, the rest is drawn directly
+        return;
+    }
+
+    int width = m_imgSize.width();
+    int height = m_imgSize.height();
+    Level level;
+    level.width = width;
+    level.height = height;
+    level.columns = 0;
+    level.rows = 0;
+    m_levels.append(level);
+    while ((width > TILE_SIZE) || (height > TILE_SIZE)) {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        level.width = width;
+        level.height = height;
+        level.columns = (width + TILE_SIZE - 1) / TILE_SIZE;
+        level.rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+        level.tiles.resize(level.columns * level.rows);
+        for (int i = 0; i < level.tiles.size(); ++i) {
+            level.tiles[i].dirtyFirst = 0;
+            level.tiles[i].dirtyLast = TILE_SIZE - 1;
+        }
+        m_levels.append(level);
+    }
+}
+
+void KSaneTileCache::invalidate()
+{
+    invalidateLines(0, m_imgSize.height() - 1);
+}
+
+void KSaneTileCache::invalidateLines(int firstLine, int lastLine)
+{
+    for (int l = 1; l < m_levels.size(); ++l) {
+        Level &level = m_levels[l];
+        int first = qMax(firstLine >> l, 0);
+        int last = qMin(lastLine >> l, level.height - 1);
+        for (int row = first / TILE_SIZE; row <= last / TILE_SIZE; ++row) {
+            int tileFirst = qMax(first - row * TILE_SIZE, 0);
+            int tileLast = qMin(last - row * TILE_SIZE, TILE_SIZE - 1);
+            for (int col = 0; col < level.columns; ++col) {
+                Tile &tile = level.tiles[row * level.columns + col];
+                if (tile.dirtyFirst > tile.dirtyLast) {
+                    tile.dirtyFirst = tileFirst;
+                    tile.dirtyLast = tileLast;
+                } else {
+                    tile.dirtyFirst = qMin(tile.dirtyFirst, tileFirst);
+                    tile.dirtyLast = qMax(tile.dirtyLast, tileLast);
+                }
+            }
+        }
+    }
+}
+
+const uchar *KSaneTileCache::tileBits(int level, int column, int row, int &bytesPerLine, int &width, int &height)
+{
+    if (level == 0) {
+        bytesPerLine = m_img->bytesPerLine();
+        width = qMin(TILE_SIZE, m_imgSize.width() - column * TILE_SIZE);
+        height = qMin(TILE_SIZE, m_imgSize.height() - row * TILE_SIZE);
+        return m_img->constBits() + (qint64)row * TILE_SIZE * bytesPerLine + column * TILE_SIZE * 4;
+    }
+    updateTile(level, column, row);
+    const QImage &image = m_levels[level].tiles[row * m_levels[level].columns + column].image;
+    bytesPerLine = image.bytesPerLine();
+    width = image.width();
+    height = image.height();
+    return image.constBits();
+}
+
+void KSaneTileCache::updateTile(int level, int column, int row)
+{
+    Level &lvl = m_levels[level];
+    Tile &tile = lvl.tiles[row * lvl.columns + column];
+    if (tile.dirtyFirst > tile.dirtyLast) {
+        return;
+    }
+    if (tile.image.isNull()) {
+        tile.image = QImage(qMin(TILE_SIZE, lvl.width - column * TILE_SIZE),
+                            qMin(TILE_SIZE, lvl.height - row * TILE_SIZE),
+                            m_img->format());
+        tile.dirtyFirst = 0;
+        tile.dirtyLast = tile.image.height() - 1;
+    }
+    int first = tile.dirtyFirst;
+    int last = qMin(tile.dirtyLast, tile.image.height() - 1);
+    // mark the tile clean first, the source tiles below are updated recursively
+    tile.dirtyFirst = TILE_SIZE;
+    tile.dirtyLast = -1;
+
+    // The tile is built from the 2x2 tiles of the level above. Each of them
+    // fills one quarter of this tile.
+    const Level &src = m_levels[level - 1];
+    uchar *dstBits = tile.image.bits();
+    const int dstBpl = tile.image.bytesPerLine();
+    for (int j = 0; j < 2; ++j) {
+        int srcRow = row * 2 + j;
+        int dstFirst = qMax(first - j * TILE_SIZE / 2, 0);
+        int dstLast = qMin(last - j * TILE_SIZE / 2, TILE_SIZE / 2 - 1);
+        if ((srcRow * TILE_SIZE >= src.height) || (dstFirst > dstLast)) {
+            continue;
+        }
+        for (int i = 0; i < 2; ++i) {
+            int srcCol = column * 2 + i;
+            if (srcCol * TILE_SIZE >= src.width) {
+                continue;
+            }
+            int srcBpl, srcWidth, srcHeight;
+            const uchar *srcBits = tileBits(level - 1, srcCol, srcRow, srcBpl, srcWidth, srcHeight);
+            int lastLine = qMin(dstLast, (srcHeight - 1) / 2);
+            for (int y = dstFirst; y <= lastLine; ++y) {
+                const quint32 *src0 = reinterpret_cast<const quint32 *>(srcBits + (qint64)(2 * y) * srcBpl);
+                const quint32 *src1 = reinterpret_cast<const quint32 *>(srcBits + (qint64)qMin(2 * y + 1, srcHeight - 1) * srcBpl);
+                quint32 *dst = reinterpret_cast<quint32 *>(dstBits + (y + j * TILE_SIZE / 2) * dstBpl) + i * TILE_SIZE / 2;
+                PixelOps::halveRgb32(dst, src0, src1, srcWidth);
+            }
+        }
+    }
+}
+
+int KSaneTileCache::levelForScale(qreal scale) const
+{
+    // use the smallest level that still has at least one pixel per screen pixel
+    int level = 0;
+    while ((level + 1 < m_levels.size()) && (scale * (1 << (level + 1)) <= 1.0)) {
+        level++;
+    }
+    return level;
+}
+
+void KSaneTileCache::draw(QPainter *painter, const QRectF &rect)
+{
+    if (!m_img || m_img->isNull()) {
+        return;
+    }
+    if ((m_img->constBits() != m_imgBits) || (m_img->size() != m_imgSize)) {
+        // the image has been replaced behind our back
+        setImage(m_img);
+    }
+
+    QRectF exposed = rect & QRectF(QPointF(0, 0), QSizeF(m_imgSize));
+    if (exposed.isEmpty()) {
+        return;
+    }
+
+    int level = levelForScale(qAbs(painter->worldTransform().m11()));
+    if (level == 0) {
+        painter->drawImage(exposed, *m_img, exposed);
+        return;
+    }
+
+    const Level &lvl = m_levels[level];
+    const qreal factor = 1 << level;
+    const qreal tileSpan = TILE_SIZE * factor;
+    int firstCol = qMax((int)(exposed.left() / tileSpan), 0);
+    int lastCol = qMin((int)(exposed.right() / tileSpan), lvl.columns - 1);
+    int firstRow = qMax((int)(exposed.top() / tileSpan), 0);
+    int lastRow = qMin((int)(exposed.bottom() / tileSpan), lvl.rows - 1);
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int col = firstCol; col <= lastCol; ++col) {
+            updateTile(level, col, row);
+            const QImage &tile = lvl.tiles[row * lvl.columns + col].image;
+            QRectF target = exposed & QRectF(col * tileSpan, row * tileSpan,
+                                             tile.width() * factor, tile.height() * factor);
+            if (target.isEmpty()) {
+                continue;
+            }
+            QRectF source(target.left() / factor - col * TILE_SIZE, target.top() / factor - row * TILE_SIZE,
+                          target.width() / factor, target.height() / factor);
+            painter->drawImage(target, tile, source);
+        }
+    }
+}
+
+}  // NameSpace KSaneIface
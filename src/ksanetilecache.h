@@ -0,0 +1,93 @@
+/* ============================================================
+ *
+ * This file is part of the KDE project
+ *
+ * Date        : 2026-10-17
+ * Description : Sane interface for KDE
+ *
+ * Copyright (C) 2026 by the KSane developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ============================================================ */
+
+
+#ifndef KSANE_TILE_CACHE_H
+#define KSANE_TILE_CACHE_H
+
+#include <QImage>
+#include <QVector>
+
+class QPainter;
+class QRectF;
+
+#define TILE_SIZE 256
+
+namespace KSaneIface
+{
+
+/** A pyramid of downscaled copies of the preview image, split into tiles.
+ * Level n is the image scaled down by 2^n. A paint only draws the tiles
+ * of the level that matches the current zoom, so a zoomed out view of a
+ * big preview does not sample the full resolution image. Tiles are built
+ * when they are first painted and only the lines that changed are rebuilt. */
+class KSaneTileCache
+{
+public:
+    KSaneTileCache();
+
+    /** Use a new image. All tiles are dropped. */
+    void setImage(const QImage *img);
+    /** Rebuild every tile before it is painted again. */
+    void invalidate();
+    /** Rebuild the given lines of the image before they are painted again. */
+    void invalidateLines(int firstLine, int lastLine);
+
+    /** Draw the part of the image inside @p rect (in image coordinates)
+     * with the level that matches the world transform of the painter. */
+    void draw(QPainter *painter, const QRectF &rect);
+
+private:
+    struct Tile {
+        QImage image;
+        int    dirtyFirst; ///< first line to rebuild, dirtyFirst > dirtyLast if the tile is clean
+        int    dirtyLast;
+    };
+    struct Level {
+        int           width;
+        int           height;
+        int           columns;
+        int           rows;
+        QVector<Tile> tiles;
+    };
+
+    void buildLevels();
+    int levelForScale(qreal scale) const;
+    /** Bring the dirty lines of a tile up to date. level must be > 0. */
+    void updateTile(int level, int column, int row);
+    /** Get the pixels of a tile. Level 0 is read straight from the image. */
+    const uchar *tileBits(int level, int column, int row, int &bytesPerLine, int &width, int &height);
+
+    const QImage   *m_img;
+    const uchar    *m_imgBits;
+    QSize           m_imgSize;
+    QVector<Level>  m_levels; ///< index 0 is the image itself and has no tiles
+};
+
+}  // NameSpace KSaneIface
+
+#endif
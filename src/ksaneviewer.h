@@ -31,6 +31,8 @@
 #include <QGraphicsView>
 #include <QWheelEvent>
 
+#include "ksaneselectiondetector.h"
+
 namespace KSaneIface
 {
 
@@ -43,9 +45,24 @@ public:
 
     void setQImage(QImage *img);
     void updateImage();
+    /** Repaint only the given lines of the image. The rest of the
+    * background cache is kept. */
+    void updateImageLines(int firstLine, int lastLine);
     /** Find selections in the picture
     * \param area this parameter determine the area of the reduced sized image. */
     void findSelections(float area = 10000.0);
+    /** Find selections in the background on a copy of the picture. The
+    * selections are added when the search is done, unless it is canceled first.
+    * \param area this parameter determine the area of the reduced sized image. */
+    void findSelectionsAsync(float area = 10000.0);
+    /** Select how findSelections() and findSelectionsAsync() search. */
+    void setSelectionMethod(KSaneSelectionDetector::Method method);
+    /** Drop the result of a running findSelectionsAsync(). This is also done
+    * when the selections are cleared or a new image is set. */
+    void cancelFindSelections();
+    /** Wait for a running findSelectionsAsync() and add its selections, so
+    * that they can be read right away. */
+    void finishFindSelections();
 
     virtual QSize sizeHint() const;
 
@@ -102,18 +119,14 @@ protected:
     void mouseMoveEvent(QMouseEvent *e);
     void drawBackground(QPainter *painter, const QRectF &rect);
 
+private Q_SLOTS:
+    void selectionJobDone();
+
 private:
     void updateSelVisibility();
     void updateHighlight();
     bool activeSelection(float &tl_x, float &tl_y, float &br_x, float &br_y);
-    void refineSelections(int pixelMargin);
-
-    // fromRow is the row to start the iterations from. fromRow can be grater than toRow.
-    // rowStart is the x1 coordinate of the row
-    // all parameters are corrected to be valid pixel indexes,
-    // but start must be < end
-    int  refineRow(int fromRow, int toRow, int rowStart, int rowEnd);
-    int  refineColumn(int fromCol, int toCol, int colStart, int colEnd);
+    void addSelections(const QList<QRectF> &selections);
 
     struct Private;
     Private *const d;
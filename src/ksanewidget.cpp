@@ -33,6 +33,7 @@
 #include "ksanewidget_p.h"
 
 #include <unistd.h>
+#include <string.h>
 
 #include <QApplication>
 #include <QVarLengthArray>
@@ -42,6 +43,7 @@
 #include <QPointer>
 #include <QDebug>
 #include <QIcon>
+#include <QtConcurrentMap>
 
 #include <kpassworddialog.h>
 #include <kwallet.h>
@@ -56,12 +58,112 @@
 #include "ksaneoptslider.h"
 #include "ksanedevicedialog.h"
 #include "labeledgamma.h"
+#include "ksanepixelops.h"
+
+// images smaller than this are not worth the thread hand-off
+#define PARALLEL_CONVERT_MIN_PIXELS (512 * 512)
+#define CONVERT_BAND_LINES 64
 
 namespace KSaneIface
 {
 static int     s_objectCount = 0;
 static QMutex  s_objectMutex;
 
+/** Converts a band of lines of packed gray or RGB data to QImage::Format_RGB32. */
+struct ConvertBand {
+    typedef void result_type;
+
+    const uchar *src;
+    int          srcBytesPerLine;
+    uchar       *dst;
+    int          dstBytesPerLine;
+    int          width;
+    int          depth;
+    bool         color;
+
+    void operator()(int firstLine)
+    {
+        for (int line = firstLine; line < firstLine + CONVERT_BAND_LINES; ++line) {
+            convert(line, src + (qint64)line * srcBytesPerLine, width);
+        }
+    }
+
+    void convert(int line, const uchar *lineData, int pixels)
+    {
+        quint32 *dstLine = reinterpret_cast<quint32 *>(dst + (qint64)line * dstBytesPerLine);
+        if (color) {
+            PixelOps::rgbToRgb32(dstLine, lineData, pixels, depth);
+        } else {
+            PixelOps::grayToRgb32(dstLine, lineData, pixels, depth);
+        }
+    }
+};
+
+/** The cleanup function of QImages that share a QByteArray. */
+static void releaseImageData(void *info)
+{
+    delete static_cast<QByteArray *>(info);
+}
+
+/** Convert gray or RGB image data to the QImage::Format_RGB32 image @p img.
+ * The data is packed without line padding. If the data ends early the rest
+ * of the image is black. */
+static void convertToRgb32(QImage &img, const QByteArray &data, KSaneWidget::ImageFormat format)
+{
+    ConvertBand band;
+    band.color = (format == KSaneWidget::FormatRGB_8_C) || (format == KSaneWidget::FormatRGB_16_C);
+    band.depth = ((format == KSaneWidget::FormatGrayScale16) || (format == KSaneWidget::FormatRGB_16_C)) ? 16 : 8;
+    const int pixelBytes = (band.color ? 3 : 1) * band.depth / 8;
+    band.src = reinterpret_cast<const uchar *>(data.constData());
+    band.srcBytesPerLine = img.width() * pixelBytes;
+    band.dst = img.bits();
+    band.dstBytesPerLine = img.bytesPerLine();
+    band.width = img.width();
+    if ((band.width == 0) || (img.height() == 0)) {
+        return;
+    }
+
+    const int lines = qMin((qint64)img.height(), (qint64)data.size() / band.srcBytesPerLine);
+    const int bands = lines / CONVERT_BAND_LINES;
+    if ((bands > 1) && ((qint64)lines * band.width >= PARALLEL_CONVERT_MIN_PIXELS)) {
+        QVector<int> firstLines(bands);
+        for (int i = 0; i < bands; ++i) {
+            firstLines[i] = i * CONVERT_BAND_LINES;
+        }
+        QtConcurrent::blockingMap(firstLines, band);
+    } else {
+        for (int i = 0; i < bands; ++i) {
+            band(i * CONVERT_BAND_LINES);
+        }
+    }
+    for (int line = bands * CONVERT_BAND_LINES; line < lines; ++line) {
+        band.convert(line, band.src + (qint64)line * band.srcBytesPerLine, band.width);
+    }
+
+    if (lines < img.height()) {
+        // A pixel is converted if the byte used for its first sample exists,
+        // missing bytes of a partial pixel count as zero.
+        int rest = data.size() - lines * band.srcBytesPerLine;
+        int sampleOffset = band.depth / 8 - 1;
+        int pixels = qMax(rest - sampleOffset + pixelBytes - 1, 0) / pixelBytes;
+        pixels = qMin(pixels, band.width);
+        QByteArray tail(band.srcBytesPerLine, 0);
+        memcpy(tail.data(), band.src + (qint64)lines * band.srcBytesPerLine, qMin(rest, band.srcBytesPerLine));
+        band.convert(lines, reinterpret_cast<const uchar *>(tail.constData()), pixels);
+
+        quint32 *dstLine = reinterpret_cast<quint32 *>(img.scanLine(lines));
+        for (int x = pixels; x < band.width; ++x) {
+            dstLine[x] = 0xFF000000;
+        }
+        for (int line = lines + 1; line < img.height(); ++line) {
+            dstLine = reinterpret_cast<quint32 *>(img.scanLine(line));
+            for (int x = 0; x < band.width; ++x) {
+                dstLine[x] = 0xFF000000;
+            }
+        }
+    }
+}
+
 static const QString InvetColorsOption = QStringLiteral("KSane::InvertColors");
 
 KSaneWidget::KSaneWidget(QWidget *parent)
@@ -126,6 +228,11 @@ KSaneWidget::KSaneWidget(QWidget *parent)
     //d->m_warmingUp->setForegroundRole(QPalette::HighlightedText);
     d->m_warmingUp->hide();
 
+    d->m_cachedPreview = new QLabel;
+    d->m_cachedPreview->setAlignment(Qt::AlignCenter);
+    d->m_cachedPreview->setWordWrap(true);
+    d->m_cachedPreview->hide();
+
     d->m_progressBar = new QProgressBar;
     d->m_progressBar->setMaximum(100);
 
@@ -183,6 +290,7 @@ KSaneWidget::KSaneWidget(QWidget *parent)
     d->m_scanBtn->setText(i18nc("Final scan button text", "Scan"));
     d->m_scanBtn->setFocus(Qt::OtherFocusReason);
     connect(d->m_scanBtn,   SIGNAL(clicked()), d, SLOT(startFinalScan()));
+    connect(&d->m_encoder,  SIGNAL(finished()), d, SLOT(encoderDone()));
 
     d->m_btnFrame = new QWidget;
     QHBoxLayout *btn_lay = new QHBoxLayout(d->m_btnFrame);
@@ -212,6 +320,7 @@ KSaneWidget::KSaneWidget(QWidget *parent)
     QVBoxLayout *preview_layout = new QVBoxLayout(d->m_previewFrame);
     preview_layout->setContentsMargins(0, 0, 0, 0);
     preview_layout->addWidget(d->m_previewViewer, 100);
+    preview_layout->addWidget(d->m_cachedPreview, 0);
     preview_layout->addWidget(d->m_warmingUp, 0);
     preview_layout->addWidget(d->m_activityFrame, 0);
     preview_layout->addWidget(d->m_btnFrame, 0);
@@ -343,6 +452,7 @@ bool KSaneWidget::openDevice(const QString &deviceName)
     }
     // save the device name
     d->m_devName = deviceName;
+    d->m_readTuner.setDevice(deviceName);
 
     // Try to open the device
     status = sane_open(deviceName.toLatin1().constData(), &d->m_saneHandle);
@@ -487,12 +597,15 @@ bool KSaneWidget::openDevice(const QString &deviceName)
     }
 
     // Create the preview thread
-    d->m_previewThread = new KSanePreviewThread(d->m_saneHandle, &d->m_previewImg);
+    d->m_previewThread = new KSanePreviewThread(d->m_saneHandle, &d->m_readTuner, &d->m_stats);
     connect(d->m_previewThread, SIGNAL(finished()), d, SLOT(previewScanDone()));
 
     // Create the read thread
-    d->m_scanThread = new KSaneScanThread(d->m_saneHandle, &d->m_scanData);
+    d->m_scanThread = new KSaneScanThread(d->m_saneHandle, &d->m_scanData, &d->m_readTuner, &d->m_stats);
     connect(d->m_scanThread, SIGNAL(finished()), d, SLOT(oneFinalScanDone()));
+    connect(d->m_scanThread, SIGNAL(imageStarted()), d, SLOT(finalImageStarted()));
+    connect(d->m_scanThread, SIGNAL(imageStripReady(QByteArray,int,int)),
+            this, SIGNAL(imageStripReady(QByteArray,int,int)));
 
     // Create the options interface
     d->createOptInterface();
@@ -509,6 +622,9 @@ bool KSaneWidget::openDevice(const QString &deviceName)
     // this is done so that you can select scan area without
     // having to scan a preview.
     d->updatePreviewSize();
+    if (d->m_previewCache) {
+        d->loadCachedPreview();
+    }
     QTimer::singleShot(1000, d->m_previewViewer, SLOT(zoom2Fit()));
     return true;
 }
@@ -554,71 +670,42 @@ QImage KSaneWidget::toQImageSilent(const QByteArray &data,
                                    ImageFormat format)
 {
     QImage img;
-    int j = 0;
     QVector<QRgb> table;
-    QRgb *imgLine;
 
     switch (format) {
-    case FormatBlackWhite:
-        img = QImage((uchar *)data.data(),
+    case FormatBlackWhite: {
+        // The image is not created read-only, setColorTable() would copy it.
+        // Instead it gets its own copy of the data, so that painting on the
+        // image does not change the caller's data, and keeps it until it is
+        // destroyed.
+        QByteArray *imageData = new QByteArray(data);
+        img = QImage(reinterpret_cast<uchar *>(imageData->data()),
                      width,
                      height,
                      bytes_per_line,
-                     QImage::Format_Mono);
+                     QImage::Format_Mono,
+                     releaseImageData,
+                     imageData);
         // The color table must be set
         table.append(0xFFFFFFFF);
         table.append(0xFF000000);
         img.setColorTable(table);
         break;
-
-    case FormatGrayScale8: {
-        img = QImage(width, height, QImage::Format_RGB32);
-        int dI = 0;
-        for (int i = 0; (i < img.height() && dI < data.size()); i++) {
-            imgLine = reinterpret_cast<QRgb *>(img.scanLine(i));
-            for (j = 0; (j < img.width() && dI < data.size()); j++) {
-                imgLine[j] = qRgb(data[dI], data[dI], data[dI]);
-                dI++;
-            }
-        }
-        break;
     }
-    case FormatGrayScale16: {
-        img = QImage(width, height, QImage::Format_RGB32);
-        int dI = 1;
-        for (int i = 0; (i < img.height() && dI < data.size()); i++) {
-            imgLine = reinterpret_cast<QRgb *>(img.scanLine(i));
-            for (j = 0; (j < img.width() && dI < data.size()); j++) {
-                imgLine[j] = qRgb(data[dI], data[dI], data[dI]);
-                dI += 2;
-            }
-        }
-        break;
-    }
-    case FormatRGB_8_C: {
+
+    case FormatGrayScale8:
+    case FormatGrayScale16:
+    case FormatRGB_8_C:
+    case FormatRGB_16_C:
         img = QImage(width, height, QImage::Format_RGB32);
-        int dI = 0;
-        for (int i = 0; (i < img.height() && dI < data.size()); i++) {
-            imgLine = reinterpret_cast<QRgb *>(img.scanLine(i));
-            for (j = 0; (j < img.width() && dI < data.size()); j++) {
-                imgLine[j] = qRgb(data[dI], data[dI + 1], data[dI + 2]);
-                dI += 3;
-            }
-        }
+        convertToRgb32(img, data, format);
         break;
-    }
-    case FormatRGB_16_C: {
-        img = QImage(width, height, QImage::Format_RGB32);
-        int dI = 1;
-        for (int i = 0; (i < img.height() && dI < data.size()); i++) {
-            imgLine = reinterpret_cast<QRgb *>(img.scanLine(i));
-            for (j = 0; (j < img.width() && dI < data.size()); j++) {
-                imgLine[j] = qRgb(data[dI], data[dI + 2], data[dI + 4]);
-                dI += 6;
-            }
-        }
+
+    case FormatBMP:
+        // the data is a complete BMP file from the image encoder
+        img = QImage::fromData(data, "BMP");
         break;
-    }
+
     case FormatNone:
     default:
         qDebug() << "Unsupported conversion";
@@ -630,6 +717,96 @@ QImage KSaneWidget::toQImageSilent(const QByteArray &data,
     return img;
 }
 
+QImage KSaneWidget::toQImageView(const QByteArray &data,
+                                 int width,
+                                 int height,
+                                 int bytes_per_line,
+                                 ImageFormat format)
+{
+    QImage::Format imgFormat;
+    int pixelBits;
+    switch (format) {
+    case FormatBlackWhite:
+        // the color table is set by toQImageSilent()
+        return toQImageSilent(data, width, height, bytes_per_line, format);
+    case FormatGrayScale8:
+        imgFormat = QImage::Format_Grayscale8;
+        pixelBits = 8;
+        break;
+    case FormatRGB_8_C:
+        imgFormat = QImage::Format_RGB888;
+        pixelBits = 24;
+        break;
+    default:
+        return toQImageSilent(data, width, height, bytes_per_line, format);
+    }
+
+    if ((width <= 0) || (height <= 0) || (bytes_per_line < (width * pixelBits) / 8) ||
+            (data.size() < (qint64)bytes_per_line * height)) {
+        // incomplete data is padded by the conversion
+        return toQImageSilent(data, width, height, bytes_per_line, format);
+    }
+
+    // The image is read-only: it keeps a shallow copy of the data until it
+    // is destroyed, and QImage makes a deep copy before it is modified.
+    QByteArray *imageData = new QByteArray(data);
+    QImage img(reinterpret_cast<const uchar *>(imageData->constData()),
+               width,
+               height,
+               bytes_per_line,
+               imgFormat,
+               releaseImageData,
+               imageData);
+    float dpm = currentDPI() * (1000.0 / 25.4);
+    img.setDotsPerMeterX(dpm);
+    img.setDotsPerMeterY(dpm);
+    return img;
+}
+
+QImage KSaneWidget::toQImageFullDepth(const QByteArray &data,
+                                      int width,
+                                      int height,
+                                      int bytes_per_line,
+                                      ImageFormat format)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+    if (((format != FormatGrayScale16) && (format != FormatRGB_16_C)) || (width <= 0) || (height <= 0)) {
+        return toQImageSilent(data, width, height, bytes_per_line, format);
+    }
+
+    const bool color = (format == FormatRGB_16_C);
+    QImage img(width, height, color ? QImage::Format_RGBX64 : QImage::Format_Grayscale16);
+    const int lineBytes = width * (color ? 6 : 2);
+    if (bytes_per_line < lineBytes) {
+        bytes_per_line = lineBytes;
+    }
+    const int lines = qMin((qint64)height, (qint64)data.size() / bytes_per_line);
+    if (lines < height) {
+        // the lines that are missing from the data are black
+        img.fill(Qt::black);
+    }
+
+    // SANE delivers 16 bit samples in the byte order of the host
+    const bool bigEndian = (Q_BYTE_ORDER == Q_BIG_ENDIAN);
+    const uchar *src = reinterpret_cast<const uchar *>(data.constData());
+    for (int line = 0; line < lines; ++line) {
+        quint16 *dst = reinterpret_cast<quint16 *>(img.scanLine(line));
+        if (color) {
+            PixelOps::rgb48ToRgbx64(dst, src + (qint64)line * bytes_per_line, width, bigEndian);
+        } else {
+            PixelOps::samples16ToHost(dst, src + (qint64)line * bytes_per_line, width, bigEndian);
+        }
+    }
+
+    float dpm = currentDPI() * (1000.0 / 25.4);
+    img.setDotsPerMeterX(dpm);
+    img.setDotsPerMeterY(dpm);
+    return img;
+#else
+    return toQImageSilent(data, width, height, bytes_per_line, format);
+#endif
+}
+
 QImage KSaneWidget::toQImage(const QByteArray &data,
                              int width,
                              int height,
@@ -819,6 +996,75 @@ void KSaneWidget::enableAutoSelect(bool enable)
     d->m_autoSelect = enable;
 }
 
+void KSaneWidget::setAutoSelectMethod(KSaneSelectionDetector::Method method)
+{
+    d->m_previewViewer->setSelectionMethod(method);
+}
+
+void KSaneWidget::enableAutoDeskew(bool enable)
+{
+    d->m_autoDeskew = enable;
+}
+
+qreal KSaneWidget::estimatePreviewSkew()
+{
+    float x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+    // the selection of the running final scan, else the first one of the next
+    int index = 0;
+    if (d->m_scanOngoing && !d->m_isPreview && (d->m_selIndex > 0)) {
+        index = d->m_selIndex - 1;
+    }
+    d->m_previewViewer->selectionAt(index, x1, y1, x2, y2);
+    return d->previewSkew(x1, y1, x2, y2);
+}
+
+void KSaneWidget::enableProgressiveScan(bool enable)
+{
+    d->m_progressiveScan = enable;
+}
+
+void KSaneWidget::setReadChunkSize(int bytes)
+{
+    d->m_readTuner.setFixedSize(bytes);
+}
+
+int KSaneWidget::readChunkSize()
+{
+    return d->m_readTuner.chunkSize();
+}
+
+KSaneWidget::ScanStatistics KSaneWidget::scanStatistics()
+{
+    return d->m_stats.statistics();
+}
+
+void KSaneWidget::enableScanToFile(bool enable, const QString &fileName)
+{
+    d->m_scanToFile = enable;
+    d->m_scanFileName = fileName;
+}
+
+void KSaneWidget::enablePreviewCache(bool enable)
+{
+    d->m_previewCache = enable;
+}
+
+bool KSaneWidget::setImageEncoder(EncodeFormat format, const QString &fileName)
+{
+    if (d->m_scanOngoing) {
+        return false;
+    }
+    return d->m_encoder.setOutput(format, fileName, 0);
+}
+
+bool KSaneWidget::setImageEncoder(EncodeFormat format, QIODevice *device)
+{
+    if (d->m_scanOngoing) {
+        return false;
+    }
+    return d->m_encoder.setOutput(format, QString(), device);
+}
+
 float KSaneWidget::currentDPI()
 {
     if (d->m_optRes) {
@@ -31,8 +31,12 @@
 #define KSANE_H
 
 #include "ksane_export.h"
+#include "ksaneselectiondetector.h"
 
 #include <QWidget>
+#include <QVector>
+
+class QIODevice;
 
 /** This namespace collects all methods and classes in LibKSane. */
 namespace KSaneIface
@@ -62,7 +66,8 @@ public:
         FormatRGB_16_C,     /**< Every pixel consists of three colors in the order Read,
                              * Grean and Blue, with two bytes per color(no alpha channel).
                              * The byte order is the one provided by libsane. */
-        FormatBMP,          /**< The image data  is returned as a BMP. */
+        FormatBMP,          /**< The image data  is returned as a BMP.
+                             * @see setImageEncoder() */
         FormatNone = 0xFFFF /**< This enumeration value should never be returned to the user */
     } ImageFormat;
 
@@ -76,6 +81,15 @@ public:
         Information          /**< There is some information to the user. */
     } ScanStatus;
 
+    /** The file formats the final scan can be encoded to while it is scanned. */
+    typedef enum {
+        EncodeNone,         /**< No encoding (default). */
+        EncodeBMP,          /**< Windows bitmap. 16 bit data is truncated to 8 bits. */
+        EncodeTIFF,         /**< Uncompressed TIFF, 16 bit data is kept. */
+        EncodeTIFFDeflate,  /**< Deflate compressed TIFF, 16 bit data is kept. */
+        EncodePNG           /**< PNG written with QImageWriter when the scan is done. */
+    } EncodeFormat;
+
     struct DeviceInfo {
         QString name;     /* unique device name */
         QString vendor;   /* device vendor string */
@@ -83,6 +97,27 @@ public:
         QString type;     /* device type (e.g., "flatbed scanner") */
     };
 
+    /** Performance figures of one preview or final scan.
+     * All times are in milliseconds. */
+    struct ScanStatistics {
+        bool   preview;         /* true for a preview scan */
+        bool   completed;       /* false if the scan failed or was canceled */
+        qint64 bytes;           /* image bytes read from the device */
+        qint64 startTime;       /* time spent in sane_start() (warm-up) */
+        qint64 firstByteTime;   /* time from the start until the first data arrived */
+        qint64 readTime;        /* time spent inside sane_read() */
+        qint64 convertTime;     /* time spent converting and storing the data */
+        qint64 emitTime;        /* time spent delivering the data to the application */
+        qint64 stallTime;       /* time the reader waited for the conversion */
+        qint64 totalTime;       /* time from the start until the end of the scan */
+        qint64 peakMemory;      /* largest amount of buffer memory in use, in bytes */
+        double bytesPerSecond;  /* bytes / totalTime */
+        int    readCalls;       /* number of sane_read() calls */
+        /* readTimeHistogram[i] is the number of sane_read() calls that took
+         * less than 2^i milliseconds (and at least 2^(i-1) for i > 0). */
+        QVector<int> readTimeHistogram;
+    };
+
     /** This constructor initializes the private class variables, but the widget is left empty.
      * The options and the preview are added with the call to openDevice(). */
     KSaneWidget(QWidget *parent = 0);
@@ -150,6 +185,47 @@ public:
                           int bytes_per_line,
                           ImageFormat format);
 
+    /**
+     * This method creates a read-only QImage that uses the image data without copying it.
+     * 'FormatGrayScale8' and 'FormatRGB_8_C' are wrapped as QImage::Format_Grayscale8
+     * and QImage::Format_RGB888. The image keeps a reference to @p data, so it stays
+     * valid when the caller's QByteArray is changed or destroyed. Use constBits() or
+     * constScanLine() to read it, QImage makes a deep copy when the image is modified.
+     * 'FormatBlackWhite' is copied to a QImage::Format_Mono image, because the color
+     * table can not be set on a read-only image. Other formats and incomplete data
+     * are converted like toQImageSilent().
+     *
+     * @param data is the byte data containing the image.
+     * @param width is the width of the image in pixels.
+     * @param height is the height of the image in pixels.
+     * @param bytes_per_line is the number of bytes used per line including padding.
+     * @param format is the KSane image format of the data.
+     * @return This function returns the provided image data as a QImage. */
+    QImage toQImageView(const QByteArray &data,
+                        int width,
+                        int height,
+                        int bytes_per_line,
+                        ImageFormat format);
+
+    /**
+     * This method creates a QImage without reducing the color depth.
+     * 'FormatGrayScale16' becomes QImage::Format_Grayscale16 and 'FormatRGB_16_C'
+     * becomes QImage::Format_RGBX64 with the samples in the byte order of the host.
+     * Other formats are converted like toQImageSilent(). With Qt versions older
+     * than 5.13 the 16 bit formats are truncated to 8 bits like in toQImageSilent().
+     *
+     * @param data is the byte data containing the image.
+     * @param width is the width of the image in pixels.
+     * @param height is the height of the image in pixels.
+     * @param bytes_per_line is the number of bytes used per line including padding.
+     * @param format is the KSane image format of the data.
+     * @return This function returns the provided image data as a QImage. */
+    QImage toQImageFullDepth(const QByteArray &data,
+                             int width,
+                             int height,
+                             int bytes_per_line,
+                             ImageFormat format);
+
     /** This method returns the vendor name of the scanner (Same as make). */
     QString vendor() const;
     /** This method returns the make name of the scanner. */
@@ -219,6 +295,88 @@ public:
     * @param enable specifies if the auto selection should be turned on or off. */
     void enableAutoSelect(bool enable);
 
+    /** This function selects how the automatic selections are searched.
+    * The default is KSaneSelectionDetector::ProjectionMethod. Use
+    * KSaneSelectionDetector::ComponentMethod for many photos or slides on the bed.
+    * @param method is the search method. */
+    void setAutoSelectMethod(KSaneSelectionDetector::Method method);
+
+    /** This function can be used to enable/disable the automatic deskew of final scans.
+    * The skew of the scanned selection is estimated on the preview and the lines
+    * of the final scan are rotated back while they are read. Without a preview
+    * of the scan area nothing is rotated. 1 bit scans, scans
+    * to a file and scans with an unknown number of lines are not rotated.
+    * The default state is disabled.
+    * @param enable specifies if the final scans should be deskewed. */
+    void enableAutoDeskew(bool enable);
+
+    /** This function estimates the skew of the content of a selection on the preview:
+    * the selection that is being scanned, or else the first one the next final scan uses.
+    * @return the skew in degrees, positive is clockwise. 0 if no preview of the
+    * scan area exists or no clear skew was found. */
+    qreal estimatePreviewSkew();
+
+    /** This function can be used to enable/disable progressive final scans.
+    * In progressive mode the image data is delivered in strips of complete lines
+    * with the imageStarted(), imageStripReady() and imageFinished() signals
+    * while the scan is ongoing and imageReady() is not emitted.
+    * The default state is disabled.
+    * @param enable specifies if progressive scanning should be turned on or off. */
+    void enableProgressiveScan(bool enable);
+
+    /** This function can be used to pin the number of bytes requested per read from
+    * the scanner. By default the size adapts to the backend and the tuned value is
+    * remembered per device between sessions.
+    * @param bytes is the read size or 0 to turn the automatic tuning back on. */
+    void setReadChunkSize(int bytes);
+
+    /** @return the number of bytes that will be requested per read from the scanner. */
+    int readChunkSize();
+
+    /** This function can be used to write final scans into a file instead of memory.
+    * The image is written with 64 bit offsets into a memory mapped file, so it can
+    * be larger than the available memory and larger than 2 GB. When enabled
+    * imageFileReady() is emitted instead of imageReady().
+    * The default state is disabled.
+    * @param enable specifies if the file output should be turned on or off.
+    * @param fileName is the file to write. If it is empty a new temporary file is
+    * created for every image and the receiver of imageFileReady() is responsible
+    * for removing it. */
+    void enableScanToFile(bool enable, const QString &fileName = QString());
+
+    /** This function can be used to keep the last preview of every device and
+    * source on disk. When a device is opened the cached preview is shown at once,
+    * marked as outdated, until a new preview is scanned. The cache is only used
+    * if the scan area of the device has not changed.
+    * The default state is disabled. Call it before openDevice().
+    * @param enable specifies if the preview cache should be turned on or off. */
+    void enablePreviewCache(bool enable);
+
+    /** This function can be used to encode final scans to an image file while they
+    * are scanned. The lines are encoded on a worker thread as they arrive, so the
+    * file is complete right after the last line. imageEncoded() is emitted when
+    * it is done. The raw image data is still delivered as usual, except for
+    * EncodeBMP without a file name: then imageReady() delivers the BMP file with
+    * FormatBMP.
+    * TIFF and images of hand scanners need a file or a random access device.
+    * The images of a batch scan after the first one are written to files with
+    * -2, -3, ... appended to the base name, or one after the other to the device.
+    * @param format is the file format or EncodeNone to stop encoding.
+    * @param fileName is the file to write.
+    * @return false if the format can not be written to the output. */
+    bool setImageEncoder(EncodeFormat format, const QString &fileName = QString());
+
+    /** This is an overloaded function.
+    * @param format is the file format or EncodeNone to stop encoding.
+    * @param device is written from the encoder thread. It is opened for writing if it
+    * is not open yet and must not be used by the application while scanning.
+    * @return false if the format can not be written to the output. */
+    bool setImageEncoder(EncodeFormat format, QIODevice *device);
+
+    /** @return the performance statistics of the last finished preview or final scan.
+     * @see scanStatisticsReady() */
+    ScanStatistics scanStatistics();
+
     /** This function is used to programatically collapse/restore the options.
     * @param collapse defines the state to set. */
     void setOptionsCollapsed(bool collapse);
@@ -249,6 +407,41 @@ Q_SIGNALS:
     void imageReady(QByteArray &data, int width, int height,
                     int bytes_per_line, int format);
 
+    /**
+     * This Signal is emitted instead of imageReady() when a final scan has been
+     * written to a file.
+     * @param fileName is the file containing the raw image data without any header.
+     * @param width is the width of the image in pixels.
+     * @param height is the height of the image in pixels.
+     * @param bytes_per_line is the number of bytes used per line.
+     * @param format is the KSane image format of the data.
+     * @see enableScanToFile() */
+    void imageFileReady(const QString &fileName, int width, int height,
+                        int bytes_per_line, int format);
+
+    /**
+     * This Signal is emitted in progressive mode when a final scan has started.
+     * @param width is the width of the image in pixels.
+     * @param height is the height of the image in pixels. Hand scanners report -1.
+     * @param bytes_per_line is the number of bytes used per line in the strips.
+     * @param format is the KSane image format of the data.
+     * @see enableProgressiveScan() */
+    void imageStarted(int width, int height, int bytes_per_line, int format);
+
+    /**
+     * This Signal is emitted in progressive mode every time new complete lines
+     * of the final scan are available. The strips arrive in order.
+     * @param data is the byte data containing the lines.
+     * @param firstLine is the index of the first line in the strip.
+     * @param lines is the number of lines in the strip. */
+    void imageStripReady(const QByteArray &data, int firstLine, int lines);
+
+    /**
+     * This Signal is emitted in progressive mode when all strips of a final scan
+     * have been delivered.
+     * @param height is the final number of lines in the image. */
+    void imageFinished(int height);
+
     /**
      * This signal is emitted when the scanning has ended.
      * @param status contains a ScanStatus status code.
@@ -271,6 +464,19 @@ Q_SIGNALS:
      * @param percent is the percentage of the scan progress (0-100). */
     void scanProgress(int percent);
 
+    /**
+     * This Signal is emitted when a preview or final scan has ended, after the
+     * image has been delivered.
+     * @param stats contains the timings, byte counts and memory use of the scan. */
+    void scanStatisticsReady(const KSaneWidget::ScanStatistics &stats);
+
+    /**
+     * This Signal is emitted when the encoder has finished writing a final scan.
+     * @param status contains a ScanStatus status code.
+     * @param strStatus If an error has occurred this string will contain an error message.
+     * @see setImageEncoder() */
+    void imageEncoded(int status, const QString &strStatus);
+
     /**
      * This signal is emitted every time the device list is updated or
      * after initGetDeviceList() is called.
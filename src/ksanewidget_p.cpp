@@ -37,8 +37,20 @@
 #include <QPushButton>
 #include <QMessageBox>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QLocale>
+#include <QtMath>
 
 #define SCALED_PREVIEW_MAX_SIDE 400
+#define PREVIEW_MIN_SIDE 300
+#define PREVIEW_DPI_STEP 25.0
+#define PREVIEW_DPI_LIMIT 600.0
 
 static const int ActiveSelection = 100000;
 
@@ -62,8 +74,14 @@ KSaneWidgetPrivate::KSaneWidgetPrivate(KSaneWidget *parent):
     m_cancelBtn     = 0;
     m_previewViewer = 0;
     m_autoSelect    = true;
+    m_autoDeskew    = false;
+    m_previewValid  = false;
+    m_progressiveScan = false;
+    m_scanToFile = false;
+    m_previewCache = false;
     m_selIndex      = ActiveSelection;
     m_warmingUp     = 0;
+    m_cachedPreview = 0;
     m_progressBar   = 0;
 
     // scanning variables
@@ -717,11 +735,183 @@ void KSaneWidgetPrivate::updatePreviewSize()
 
     m_previewImg = QImage(x, y, QImage::Format_RGB32);
     m_previewImg.fill(0xFFFFFFFF);
+    m_previewValid = false;
+    m_cachedPreview->hide();
 
     // set the new image
     m_previewViewer->setQImage(&m_previewImg);
 }
 
+QString KSaneWidgetPrivate::cachedPreviewFile()
+{
+    QString source;
+    if (m_optSource != 0) {
+        m_optSource->getValue(source);
+    }
+    QByteArray key = m_devName.toUtf8() + '\n' + source.toUtf8();
+    QString name = QString::fromLatin1(QCryptographicHash::hash(key, QCryptographicHash::Md5).toHex());
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) +
+           QStringLiteral("/libksane/previews/") + name + QStringLiteral(".png");
+}
+
+void KSaneWidgetPrivate::loadCachedPreview()
+{
+    QImage img(cachedPreviewFile());
+    if (img.isNull()) {
+        return;
+    }
+    // The preview is only valid for the same scan area
+    if ((qAbs(img.text(QStringLiteral("ksane-width")).toFloat() - m_previewWidth) > 0.01) ||
+            (qAbs(img.text(QStringLiteral("ksane-height")).toFloat() - m_previewHeight) > 0.01)) {
+        qDebug() << "The scan area has changed, ignoring the cached preview";
+        return;
+    }
+
+    m_previewImg = img.convertToFormat(QImage::Format_RGB32);
+    m_previewValid = true;
+    m_previewViewer->setQImage(&m_previewImg);
+    m_previewViewer->zoom2Fit();
+
+    QDateTime time = QDateTime::fromString(img.text(QStringLiteral("ksane-time")), Qt::ISODate);
+    m_cachedPreview->setText(i18n("This preview was scanned at %1 dpi on %2. "
+                                  "Press Preview to update it.",
+                                  img.text(QStringLiteral("ksane-dpi")),
+                                  QLocale().toString(time.toLocalTime(), QLocale::ShortFormat)));
+    m_cachedPreview->show();
+}
+
+void KSaneWidgetPrivate::saveCachedPreview(float dpi)
+{
+    QString fileName = cachedPreviewFile();
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+    QImage img = m_previewImg;
+    img.setText(QStringLiteral("ksane-width"), QString::number(m_previewWidth));
+    img.setText(QStringLiteral("ksane-height"), QString::number(m_previewHeight));
+    img.setText(QStringLiteral("ksane-dpi"), QString::number(dpi));
+    img.setText(QStringLiteral("ksane-time"), QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    if (!img.save(fileName, "PNG")) {
+        qDebug() << "Failed to save the preview to" << fileName;
+    }
+}
+
+void KSaneWidgetPrivate::setPreviewResolution(float dpi)
+{
+    m_optRes->setValue(dpi);
+    if ((m_optResY != 0) && (m_optRes->name() == QStringLiteral(SANE_NAME_SCAN_X_RESOLUTION))) {
+        m_optResY->setValue(dpi);
+    }
+}
+
+QString KSaneWidgetPrivate::previewResolutionKey()
+{
+    QString source;
+    QString mode;
+    if (m_optSource != 0) {
+        m_optSource->getValue(source);
+    }
+    if (m_optMode != 0) {
+        m_optMode->getValue(mode);
+    }
+    float width = 0;
+    float height = 0;
+    if ((m_optBrX != 0) && (m_optBrY != 0)) {
+        m_optBrX->getValue(width);
+        m_optBrY->getValue(height);
+    }
+    QString key = QStringLiteral("%1|%2|%3|%4x%5").arg(m_devName, source, mode)
+                  .arg(width, 0, 'f', 1).arg(height, 0, 'f', 1);
+    // QSettings uses '/' as the group separator
+    return key.replace(QLatin1Char('/'), QLatin1Char('_'));
+}
+
+static bool previewBigEnough(const SANE_Parameters &params)
+{
+    return (params.pixels_per_line >= PREVIEW_MIN_SIDE) &&
+           ((params.lines <= 0) || (params.lines >= PREVIEW_MIN_SIDE));
+}
+
+bool KSaneWidgetPrivate::negotiatePreviewResolution()
+{
+    // Every probe is an option write and a sane_get_parameters() call, which
+    // is a network round trip for remote scanners. The result is reused for
+    // the same device, source, mode and scan area.
+    QString key = previewResolutionKey();
+    QSettings settings(QStringLiteral("KDE"), QStringLiteral("libksane"));
+    settings.beginGroup(QStringLiteral("PreviewResolution"));
+    float cached = settings.value(key, 0.0).toFloat();
+    if (cached >= 1.0) {
+        setPreviewResolution(cached);
+        return true;
+    }
+
+    // The resolutions tried are the minimum and then PREVIEW_DPI_STEP
+    // increments up to the first one above PREVIEW_DPI_LIMIT.
+    float minDpi = 0;
+    float maxDpi;
+    m_optRes->getMinValue(minDpi);
+    if (!m_optRes->getMaxValue(maxDpi)) {
+        maxDpi = PREVIEW_DPI_LIMIT + PREVIEW_DPI_STEP;
+    }
+    int maxStep = qMax((int)((PREVIEW_DPI_LIMIT - minDpi) / PREVIEW_DPI_STEP) + 1, 0);
+    maxStep = qMin(maxStep, qMax(qCeil((maxDpi - minDpi) / PREVIEW_DPI_STEP), 0));
+
+    SANE_Parameters params;
+    SANE_Status status;
+    setPreviewResolution(minDpi);
+    status = sane_get_parameters(m_saneHandle, &params);
+    if (status != SANE_STATUS_GOOD) {
+        qDebug() << "sane_get_parameters=" << sane_strstatus(status);
+        return false;
+    }
+    if (params.pixels_per_line == 0) {
+        // This is a security measure for broken backends
+        qDebug() << "Setting minimum DPI value for a broken back-end";
+        return true;
+    }
+
+    int tooSmall = -1;  // the largest step known to give a too small preview
+    int bigEnough = maxStep;
+    if (previewBigEnough(params) || (maxStep == 0)) {
+        bigEnough = 0;
+    } else {
+        tooSmall = 0;
+        // The image size grows linearly with the resolution, so the first
+        // probe is computed from the size at the minimum resolution.
+        int side = params.pixels_per_line;
+        if (params.lines > 0) {
+            side = qMin(side, params.lines);
+        }
+        float estimate = minDpi * PREVIEW_MIN_SIDE / qMax(side, 1);
+        int step = qBound(1, qCeil((estimate - minDpi) / PREVIEW_DPI_STEP), maxStep);
+        // Bisect if the backend does not scale linearly
+        bool firstProbe = true;
+        while ((step > tooSmall) && (step < bigEnough)) {
+            setPreviewResolution(minDpi + step * PREVIEW_DPI_STEP);
+            status = sane_get_parameters(m_saneHandle, &params);
+            if (status != SANE_STATUS_GOOD) {
+                qDebug() << "sane_get_parameters=" << sane_strstatus(status);
+                return false;
+            }
+            if (previewBigEnough(params)) {
+                bigEnough = step;
+                if (firstProbe) {
+                    break;
+                }
+            } else {
+                tooSmall = step;
+            }
+            firstProbe = false;
+            step = (tooSmall + bigEnough + 1) / 2;
+        }
+    }
+
+    float dpi = minDpi + bigEnough * PREVIEW_DPI_STEP;
+    setPreviewResolution(dpi);
+    settings.setValue(key, dpi);
+    return true;
+}
+
 void KSaneWidgetPrivate::startPreviewScan()
 {
     if (m_scanOngoing) {
@@ -729,9 +919,7 @@ void KSaneWidgetPrivate::startPreviewScan()
     }
     m_scanOngoing = true;
 
-    SANE_Status status;
     float max_x, max_y;
-    float dpi;
 
     // store the current settings of parameters to be changed
     if (m_optDepth != 0) {
@@ -769,41 +957,10 @@ void KSaneWidgetPrivate::startPreviewScan()
 
     if (m_optRes != 0) {
         if (m_previewDPI >= 25.0) {
-            m_optRes->setValue(m_previewDPI);
-            if ((m_optResY != 0) && (m_optRes->name() == QStringLiteral(SANE_NAME_SCAN_X_RESOLUTION))) {
-                m_optResY->setValue(m_previewDPI);
-            }
-        } else {
-            // set the resopution to getMinValue and increase if necessary
-            SANE_Parameters params;
-            m_optRes->getMinValue(dpi);
-            do {
-                m_optRes->setValue(dpi);
-                if ((m_optResY != 0) && (m_optRes->name() == QStringLiteral(SANE_NAME_SCAN_X_RESOLUTION))) {
-                    m_optResY->setValue(dpi);
-                }
-                //check what image size we would get in a scan
-                status = sane_get_parameters(m_saneHandle, &params);
-                if (status != SANE_STATUS_GOOD) {
-                    qDebug() << "sane_get_parameters=" << sane_strstatus(status);
-                    previewScanDone();
-                    return;
-                }
-
-                if (dpi > 600) {
-                    break;
-                }
-
-                // Increase the dpi value
-                dpi += 25.0;
-            } while ((params.pixels_per_line < 300) || ((params.lines > 0) && (params.lines < 300)));
-
-            if (params.pixels_per_line == 0) {
-                // This is a security measure for broken backends
-                m_optRes->getMinValue(dpi);
-                m_optRes->setValue(dpi);
-                qDebug() << "Setting minimum DPI value for a broken back-end";
-            }
+            setPreviewResolution(m_previewDPI);
+        } else if (!negotiatePreviewResolution()) {
+            previewScanDone();
+            return;
         }
     }
 
@@ -822,6 +979,8 @@ void KSaneWidgetPrivate::startPreviewScan()
     m_previewViewer->clearHighlight();
     m_previewViewer->clearSelections();
     m_previewImg.fill(0xFFFFFFFF);
+    m_previewValid = false;
+    m_cachedPreview->hide();
     updatePreviewSize();
 
     setBusy(true);
@@ -847,6 +1006,11 @@ void KSaneWidgetPrivate::previewScanDone()
         return;
     }
 
+    float previewDpi = 0;
+    if (m_optRes != 0) {
+        m_optRes->getValue(previewDpi);
+    }
+
     // restore the original settings of the changed parameters
     if (m_optDepth != 0) {
         m_optDepth->restoreSavedData();
@@ -864,20 +1028,31 @@ void KSaneWidgetPrivate::previewScanDone()
         m_optPreview->restoreSavedData();
     }
 
+    syncPreviewImage();
     m_previewViewer->setQImage(&m_previewImg);
     m_previewViewer->zoom2Fit();
 
     if ((m_previewThread->status != SANE_STATUS_GOOD) &&
             (m_previewThread->status != SANE_STATUS_EOF)) {
         alertUser(KSaneWidget::ErrorGeneral, i18n(sane_strstatus(m_previewThread->status)));
-    } else if (m_autoSelect) {
-        m_previewViewer->findSelections();
+    } else {
+        // a canceled preview does not show the whole scan area
+        m_previewValid = m_stats.statistics().completed;
+        // a canceled preview is not worth keeping
+        if (m_previewCache && m_previewValid) {
+            saveCachedPreview(previewDpi);
+        }
+        if (m_autoSelect) {
+            // keep the GUI responsive on big previews
+            m_previewViewer->findSelectionsAsync();
+        }
     }
 
     setBusy(false);
     m_scanOngoing = false;
     m_updProgressTmr.stop();
 
+    emit(q->scanStatisticsReady(m_stats.statistics()));
     emit(q->scanDone(KSaneWidget::NoError, QStringLiteral("")));
 
     return;
@@ -890,6 +1065,9 @@ void KSaneWidgetPrivate::startFinalScan()
     }
     m_scanOngoing = true;
     m_isPreview = false;
+    // scan the selections of a running search too; after this they do
+    // not change before the next preview
+    m_previewViewer->finishFindSelections();
 
     float x1 = 0, y1 = 0, x2 = 0, y2 = 0, max_x, max_y;
 
@@ -903,6 +1081,7 @@ void KSaneWidgetPrivate::startFinalScan()
         // reead the selection from the viewer
         m_previewViewer->selectionAt(m_selIndex, x1, y1, x2, y2);
         m_previewViewer->setHighlightArea(x1, y1, x2, y2);
+        updateDeskew(x1, y1, x2, y2);
         m_selIndex++;
 
         // calculate the option values
@@ -914,6 +1093,8 @@ void KSaneWidgetPrivate::startFinalScan()
         m_optTlY->setValue(y1);
         m_optBrX->setValue(x2);
         m_optBrY->setValue(y2);
+    } else {
+        updateDeskew(0, 0, 1, 1);
     }
 
     // execute a pending value reload
@@ -925,9 +1106,65 @@ void KSaneWidgetPrivate::startFinalScan()
     setBusy(true);
     m_updProgressTmr.start();
     m_scanThread->setImageInverted(m_invertColors->isChecked());
+    m_scanThread->setProgressive(m_progressiveScan);
+    m_scanThread->setOutputFile(m_scanToFile, m_scanFileName);
+    if (m_encoder.format() != KSaneWidget::EncodeNone) {
+        float dpi = 0;
+        if (m_optRes) {
+            m_optRes->getValue(dpi);
+        }
+        m_encoder.setResolution(dpi);
+        m_encoder.startBatch();
+        m_scanThread->setEncoder(&m_encoder);
+    } else {
+        m_scanThread->setEncoder(0);
+    }
     m_scanThread->start();
 }
 
+qreal KSaneWidgetPrivate::previewSkew(float tl_x, float tl_y, float br_x, float br_y)
+{
+    // the blank preview of a new scan area would give an arbitrary angle
+    if (!m_previewValid) {
+        return 0;
+    }
+    QRect area(QPoint((int)(tl_x * m_previewImg.width()), (int)(tl_y * m_previewImg.height())),
+               QPoint((int)(br_x * m_previewImg.width()) - 1, (int)(br_y * m_previewImg.height()) - 1));
+    area = area.intersected(m_previewImg.rect());
+    if (area.isEmpty()) {
+        return 0;
+    }
+    KSaneSelectionDetector detector;
+    return detector.estimateSkew(m_previewImg.copy(area));
+}
+
+void KSaneWidgetPrivate::updateDeskew(float tl_x, float tl_y, float br_x, float br_y)
+{
+    qreal angle = 0;
+    if (m_autoDeskew) {
+        angle = previewSkew(tl_x, tl_y, br_x, br_y);
+    }
+    m_scanThread->setDeskewAngle(angle);
+}
+
+void KSaneWidgetPrivate::finalImageStarted()
+{
+    SANE_Parameters params = m_scanThread->imageParameters();
+    emit(q->imageStarted(params.pixels_per_line,
+                         params.lines,
+                         getBytesPerLines(params),
+                         (int)getImgFormat(params)));
+}
+
+void KSaneWidgetPrivate::encoderDone()
+{
+    if (m_encoder.succeeded()) {
+        emit(q->imageEncoded(KSaneWidget::NoError, QString()));
+    } else {
+        emit(q->imageEncoded(KSaneWidget::ErrorGeneral, m_encoder.errorString()));
+    }
+}
+
 void KSaneWidgetPrivate::oneFinalScanDone()
 {
     m_updProgressTmr.stop();
@@ -944,17 +1181,51 @@ void KSaneWidgetPrivate::oneFinalScanDone()
     if (m_scanThread->frameStatus() == KSaneScanThread::READ_READY) {
         // scan finished OK
         SANE_Parameters params = m_scanThread->saneParameters();
-        int lines = params.lines;
-        if (lines == -1) {
-            // this is probably a handscanner -> calculate the size from the read data
-            int bytesPerLine = qMax(getBytesPerLines(params), 1); // ensure no div by 0
-            lines = m_scanData.size() / bytesPerLine;
+        QElapsedTimer emitTimer;
+        emitTimer.start();
+        if (m_progressiveScan) {
+            // the image data has already been delivered in strips
+            emit(q->imageFinished(m_scanThread->stripLines()));
+        }
+        if (m_scanToFile) {
+            int lines = params.lines;
+            if (lines == -1) {
+                int bytesPerLine = qMax(getBytesPerLines(params), 1); // ensure no div by 0
+                lines = (int)(m_scanThread->outputSize() / bytesPerLine);
+            }
+            emit(q->imageFileReady(m_scanThread->outputFileName(),
+                                   params.pixels_per_line,
+                                   lines,
+                                   getBytesPerLines(params),
+                                   (int)getImgFormat(params)));
+        } else if (!m_progressiveScan) {
+            int lines = params.lines;
+            if (lines == -1) {
+                // this is probably a handscanner -> calculate the size from the read data
+                int bytesPerLine = qMax(getBytesPerLines(params), 1); // ensure no div by 0
+                lines = m_scanData.size() / bytesPerLine;
+            }
+            if (m_encoder.toMemory()) {
+                // the encoder is done with the last line shortly after the scan thread
+                m_encoder.wait();
+            }
+            if (m_encoder.toMemory() && m_encoder.succeeded()) {
+                QByteArray bmp = m_encoder.encodedData();
+                emit(q->imageReady(bmp,
+                                   params.pixels_per_line,
+                                   lines,
+                                   0,
+                                   (int)KSaneWidget::FormatBMP));
+            } else {
+                emit(q->imageReady(m_scanData,
+                                   params.pixels_per_line,
+                                   lines,
+                                   getBytesPerLines(params),
+                                   (int)getImgFormat(params)));
+            }
         }
-        emit(q->imageReady(m_scanData,
-                           params.pixels_per_line,
-                           lines,
-                           getBytesPerLines(params),
-                           (int)getImgFormat(params)));
+        m_stats.addEmit(emitTimer.nsecsElapsed() / 1000);
+        emit(q->scanStatisticsReady(m_stats.statistics()));
 
         // now check if we should have automatic ADF batch scaning
         if (m_optSource) {
@@ -1005,6 +1276,7 @@ void KSaneWidgetPrivate::oneFinalScanDone()
 
                 // set the highlight
                 m_previewViewer->setHighlightArea(x1, y1, x2, y2);
+                updateDeskew(x1, y1, x2, y2);
 
                 // calculate the option values
                 x1 *= max_x; y1 *= max_y;
@@ -1029,6 +1301,7 @@ void KSaneWidgetPrivate::oneFinalScanDone()
         }
         emit(q->scanDone(KSaneWidget::NoError, QStringLiteral("")));
     } else {
+        emit(q->scanStatisticsReady(m_stats.statistics()));
         switch (m_scanThread->saneStatus()) {
         case SANE_STATUS_GOOD:
         case SANE_STATUS_CANCELLED:
@@ -1117,24 +1390,36 @@ void KSaneWidgetPrivate::invertPreview()
     m_previewViewer->updateImage();
 }
 
+bool KSaneWidgetPrivate::syncPreviewImage()
+{
+    QImage img = m_previewThread->image();
+    if (img.isNull() || (img.constBits() == m_previewImg.constBits())) {
+        return false;
+    }
+    // share the pixel data the preview thread is drawing into
+    m_previewImg = img;
+    return true;
+}
+
 void KSaneWidgetPrivate::updateProgress()
 {
     int progress;
     if (m_isPreview) {
         progress = m_previewThread->scanProgress();
         if (m_previewThread->saneStartDone()) {
-            if (!m_progressBar->isVisible() || m_previewThread->imageResized()) {
+            bool newImage = syncPreviewImage();
+            int first, last;
+            if (!m_progressBar->isVisible() || newImage) {
                 m_warmingUp->hide();
                 m_activityFrame->show();
                 // the image size might have changed
-                m_previewThread->imgMutex.lock();
                 m_previewViewer->setQImage(&m_previewImg);
                 m_previewViewer->zoom2Fit();
-                m_previewThread->imgMutex.unlock();
-            } else {
-                m_previewThread->imgMutex.lock();
-                m_previewViewer->updateImage();
-                m_previewThread->imgMutex.unlock();
+                // the whole image is repainted anyway
+                m_previewThread->takeDirtyLines(first, last);
+            } else if (m_previewThread->takeDirtyLines(first, last)) {
+                // only repaint the lines that arrived since the last update
+                m_previewViewer->updateImageLines(first, last);
             }
         }
     } else {
@@ -51,6 +51,7 @@ extern "C"
 #include "labeledcheckbox.h"
 #include "splittercollapser.h"
 #include "ksanescanthread.h"
+#include "ksaneimageencoder.h"
 #include "ksanepreviewthread.h"
 #include "ksanefinddevicesthread.h"
 #include "ksaneauth.h"
@@ -69,11 +70,26 @@ public:
     void clearDeviceOptions();
     void createOptInterface();
     void updatePreviewSize();
+    /** Share the image the preview thread draws into. @return true if it changed. */
+    bool syncPreviewImage();
     void setDefaultValues();
     void setBusy(bool busy);
+    void setPreviewResolution(float dpi);
+    /** Find the lowest resolution that gives a preview of at least
+    * PREVIEW_MIN_SIDE pixels. @return false if sane_get_parameters() failed. */
+    bool negotiatePreviewResolution();
+    QString previewResolutionKey();
+    QString cachedPreviewFile();
+    void loadCachedPreview();
+    void saveCachedPreview(float dpi);
     KSaneOption *getOption(const QString &name);
     KSaneWidget::ImageFormat getImgFormat(SANE_Parameters &params);
     int getBytesPerLines(SANE_Parameters &params);
+    /** @return the skew of the preview inside the given selection in degrees.
+     * 0 if there is no preview of the current scan area. */
+    qreal previewSkew(float tl_x, float tl_y, float br_x, float br_y);
+    /** Set the rotation of the next final scan from the selection it scans. */
+    void updateDeskew(float tl_x, float tl_y, float br_x, float br_y);
 
 public Q_SLOTS:
     void devListUpdated();
@@ -81,6 +97,8 @@ public Q_SLOTS:
     void startFinalScan();
     void previewScanDone();
     void oneFinalScanDone();
+    void finalImageStarted();
+    void encoderDone();
     void updateProgress();
 
 private Q_SLOTS:
@@ -128,6 +146,7 @@ public:
 
     QWidget            *m_activityFrame;
     QLabel             *m_warmingUp;
+    QLabel             *m_cachedPreview;
     QProgressBar       *m_progressBar;
     QPushButton        *m_cancelBtn;
 
@@ -165,13 +184,19 @@ public:
     float               m_previewHeight;
     float               m_previewDPI;
     QImage              m_previewImg;
+    bool                m_previewValid;     ///< m_previewImg shows the current scan area
     bool                m_isPreview;
     bool                m_autoSelect;
+    bool                m_autoDeskew;
 
     int                 m_selIndex;
 
     bool                m_scanOngoing;
     bool                m_closeDevicePending;
+    bool                m_progressiveScan;
+    bool                m_scanToFile;
+    QString             m_scanFileName;
+    bool                m_previewCache;
 
     // final image data
     QByteArray          m_scanData;
@@ -182,6 +207,9 @@ public:
     QTimer              m_optionPollTmr;
     KSaneScanThread    *m_scanThread;
     KSanePreviewThread *m_previewThread;
+    KSaneReadTuner      m_readTuner;
+    KSaneStatsRecorder  m_stats;
+    KSaneImageEncoder   m_encoder;
 
     QString             m_saneUserName;
     QString             m_sanePassword;
@@ -30,16 +30,157 @@
 
 #include <QDebug>
 #include <QApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+
+static const int BENCHMARK_PAINTS = 20;
+static const int BENCHMARK_SELECTIONS = 20;
+
+/** Time full repaints of the viewer at a range of zoom levels. */
+static void paintBenchmark(KSaneIface::KSaneViewer &viewer, QImage *img)
+{
+    viewer.resize(1024, 768);
+    viewer.show();
+    QApplication::processEvents();
+
+    // setQImage() resets the zoom to 1:1, every step zooms out by 1.5
+    viewer.setQImage(img);
+    for (int step = 0; step < 10; ++step) {
+        QElapsedTimer timer;
+        viewer.resetCachedContent();
+        timer.start();
+        viewer.viewport()->repaint();
+        qint64 first = timer.nsecsElapsed();
+
+        timer.restart();
+        for (int i = 0; i < BENCHMARK_PAINTS; ++i) {
+            viewer.resetCachedContent();
+            viewer.viewport()->repaint();
+        }
+        qint64 average = timer.nsecsElapsed() / BENCHMARK_PAINTS;
+
+        qDebug() << "scale" << viewer.transform().m11()
+                 << "first paint" << first / 1000 << "us"
+                 << "average paint" << average / 1000 << "us";
+        viewer.zoomOut();
+    }
+}
+
+/** Read the expected objects of an image. Every line has the x, y, width
+ * and height of one object in the range 0.0 -> 1.0. */
+static QList<QRectF> readTruth(const QString &fileName)
+{
+    QList<QRectF> truth;
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qDebug() << "Can not read" << fileName;
+        return truth;
+    }
+    while (!file.atEnd()) {
+        QStringList values = QString::fromUtf8(file.readLine()).simplified().split(QLatin1Char(' '));
+        if (values.size() == 4) {
+            truth.append(QRectF(values[0].toDouble(), values[1].toDouble(), values[2].toDouble(), values[3].toDouble()));
+        }
+    }
+    return truth;
+}
+
+static qreal intersectionOverUnion(const QRectF &a, const QRectF &b)
+{
+    QRectF common = a.intersected(b);
+    qreal commonArea = common.width() * common.height();
+    qreal unionArea = a.width() * a.height() + b.width() * b.height() - commonArea;
+    return (unionArea > 0) ? commonArea / unionArea : 0;
+}
+
+/** Time the automatic selection with both methods and the skew estimation and
+ * print the results, so that the output of two builds can be compared. With a
+ * truth file the objects are also matched against the expected ones. */
+static void selectionBenchmark(const QImage &img, const QString &truthFile)
+{
+    QList<QRectF> truth;
+    if (!truthFile.isEmpty()) {
+        truth = readTruth(truthFile);
+    }
+
+    KSaneIface::KSaneSelectionDetector detector;
+    const KSaneIface::KSaneSelectionDetector::Method methods[2] = {
+        KSaneIface::KSaneSelectionDetector::ProjectionMethod,
+        KSaneIface::KSaneSelectionDetector::ComponentMethod
+    };
+    for (int m = 0; m < 2; ++m) {
+        detector.setMethod(methods[m]);
+        QList<KSaneIface::KSaneSelectionDetector::Object> objects;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < BENCHMARK_SELECTIONS; ++i) {
+            objects = detector.detectObjects(img);
+        }
+        qDebug() << (m == 0 ? "projection" : "components")
+                 << "average" << timer.nsecsElapsed() / BENCHMARK_SELECTIONS / 1000 << "us"
+                 << objects.size() << "objects";
+        for (int i = 0; i < objects.size(); ++i) {
+            qDebug() << "  object" << i << objects[i].rect << "angle" << objects[i].angle;
+        }
+
+        if (truth.isEmpty()) {
+            continue;
+        }
+        int found = 0;
+        qreal iouSum = 0;
+        for (int t = 0; t < truth.size(); ++t) {
+            qreal best = 0;
+            for (int i = 0; i < objects.size(); ++i) {
+                best = qMax(best, intersectionOverUnion(truth[t], objects[i].rect));
+            }
+            iouSum += best;
+            if (best >= 0.5) {
+                found++;
+            }
+        }
+        qDebug() << "  found" << found << "of" << truth.size()
+                 << "mean IoU" << iouSum / truth.size()
+                 << "extra" << qMax(objects.size() - found, 0);
+    }
+
+    qreal skew = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < BENCHMARK_SELECTIONS; ++i) {
+        skew = detector.estimateSkew(img);
+    }
+    qDebug() << "skew" << "average" << timer.nsecsElapsed() / BENCHMARK_SELECTIONS / 1000 << "us"
+             << "angle" << skew;
+}
 
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
-    if (argc != 2) {
+    bool benchmark = (argc == 3) && (qstrcmp(argv[1], "--paint-benchmark") == 0);
+    bool selBenchmark = ((argc == 3) || (argc == 4)) && (qstrcmp(argv[1], "--selection-benchmark") == 0);
+    if ((argc != 2) && !benchmark && !selBenchmark) {
         qDebug() << "An image filename is needed.";
+        qDebug() << "Usage:" << argv[0] << "[--paint-benchmark] image";
+        qDebug() << "      " << argv[0] << "--selection-benchmark image [truth]";
         return 1;
     }
-    QImage img(QString::fromUtf8(argv[1]));
+    QImage img(QString::fromUtf8(argv[selBenchmark ? 2 : argc - 1]));
+
+    if (benchmark) {
+        // the preview is always drawn from an RGB32 image
+        img = img.convertToFormat(QImage::Format_RGB32);
+        KSaneIface::KSaneViewer viewer(&img);
+        paintBenchmark(viewer, &img);
+        return 0;
+    }
+
+    if (selBenchmark) {
+        img = img.convertToFormat(QImage::Format_RGB32);
+        selectionBenchmark(img, (argc == 4) ? QString::fromUtf8(argv[3]) : QString());
+        return 0;
+    }
 
     KSaneIface::KSaneViewer viewer(&img);
 